@@ -0,0 +1,246 @@
+// Command line driver that evolves a whole word list, streaming it through in chunks
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+#include <cerrno>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <cstring>
+#include <cstdlib>
+#include <err.hpp>
+#include <natevolve.hpp>
+#include <mapfile.hpp>
+#include <pool.hpp>
+#include <sndwrp.hpp>
+#include <romanizer.hpp>
+
+// Lines decoded and evolved at once. Bounds memory use regardless of the input's size
+static constexpr size_t ChunkLines = 1 << 16;
+
+// Lines per task handed to the pool
+static constexpr size_t TaskLines = 1024;
+
+static void printUsage(const char *const name) {
+    std::fprintf(
+        stderr,
+        "Usage: %s [-r <romanization.rmz>] [-o <output>] [-j <threads>] <changes.sw> <words>\n"
+        "       %s [-o <output>] [-j <threads>] (romanize | unromanize) <romanization.rmz> <text>\n"
+        "Evolves every line of a UTF-8 word list and writes one line per word,\n"
+        "or romanizes or unromanizes a whole UTF-8 text\n",
+        name, name
+    );
+}
+
+static void printError(const natevolve::Error &error) {
+    std::string message;
+    natevolve::encodeUtf8(error.message.data(), error.message.length(), message);
+    std::fprintf(stderr, "%s\n", message.c_str());
+}
+
+// Evolve every line of input through cascade, optionally romanizing, and write it to output
+static bool evolve(
+        const natevolve::sndwrp::Cascade &cascade,
+        const natevolve::romanizer::Romanizer *const romanizer,
+        natevolve::MappedFile &input, FILE *const output, const size_t threads) {
+    natevolve::Pool pool(threads);
+    std::vector<natevolve::sndwrp::Workspace> workspaces(pool.workers());
+    std::vector<std::wstring> changed(pool.workers());
+    std::vector<std::wstring> romanized(pool.workers());
+    std::vector<std::wstring> lines(ChunkLines);
+    std::vector<std::string> encoded((ChunkLines + TaskLines - 1) / TaskLines);
+    std::vector<std::vector<natevolve::Error>> errors(encoded.size());
+    size_t pos = 0;
+    size_t firstLine = 1;
+    bool failed = false;
+    while (pos < input.size) {
+        // Split off the next chunk of lines. A trailing \r from Windows line endings is dropped
+        size_t count = 0;
+        while (count < ChunkLines && pos < input.size) {
+            const auto newline = static_cast<const char *>(
+                std::memchr(input.data + pos, '\n', input.size - pos)
+            );
+            const auto end = newline == nullptr ? input.size : newline - input.data;
+            auto len = end - pos;
+            if (len > 0 && input.data[pos + len - 1] == '\r') {
+                len--;
+            }
+            lines[count].clear();
+            natevolve::decodeUtf8(input.data + pos, len, lines[count]);
+            count++;
+            pos = end + 1;
+        }
+
+        pool.parallelFor(count, TaskLines, [&](size_t begin, size_t end, size_t worker) {
+            auto &out = encoded[begin / TaskLines];
+            auto &taskErrors = errors[begin / TaskLines];
+            auto &word = changed[worker];
+            out.clear();
+            taskErrors.clear();
+            for (size_t i = begin; i < end; i++) {
+                const auto error = cascade.apply(lines[i], word, workspaces[worker]);
+                if (error.has_value()) {
+                    // Keep the output lined up with the input
+                    taskErrors.push_back(natevolve::Error {
+                        error.value().type,
+                        L"Line " + std::to_wstring(firstLine + i) + L": " + error.value().message
+                    });
+                    out.push_back('\n');
+                    continue;
+                }
+                if (romanizer != nullptr) {
+                    auto &romWord = romanized[worker];
+                    romanizer->romanize(word, romWord);
+                    natevolve::encodeUtf8(romWord.data(), romWord.length(), out);
+                } else {
+                    natevolve::encodeUtf8(word.data(), word.length(), out);
+                }
+                out.push_back('\n');
+            }
+        });
+
+        for (size_t task = 0; task * TaskLines < count; task++) {
+            for (const auto &error : errors[task]) {
+                printError(error);
+                failed = true;
+            }
+            std::fwrite(encoded[task].data(), 1, encoded[task].size(), output);
+        }
+        input.release(pos);
+        firstLine += count;
+    }
+
+    return !failed;
+}
+
+// Bytes of text converted between writes in romanize mode
+static constexpr size_t ConvertWindow = 64 << 20;
+
+// Romanize or unromanize all of input and write it to output
+static void convert(
+        const natevolve::romanizer::Romanizer &romanizer, const bool romanizing,
+        natevolve::MappedFile &input, FILE *const output, const size_t threads) {
+    natevolve::Pool pool(threads);
+    const std::string_view text(input.data, input.size);
+    std::string out;
+    size_t pos = 0;
+    while (pos < text.length()) {
+        const auto end = romanizer.safeSplit(text, pos + ConvertWindow, romanizing);
+        out.clear();
+        if (romanizing) {
+            romanizer.romanizeCorpus(text.substr(pos, end - pos), out, pool);
+        } else {
+            romanizer.unromanizeCorpus(text.substr(pos, end - pos), out, pool);
+        }
+        std::fwrite(out.data(), 1, out.size(), output);
+        input.release(end);
+        pos = end;
+    }
+}
+
+int main(int argc, char **argv) {
+    natevolve::enableUtf8();
+#ifdef _WIN32
+    // Output is written as raw UTF-8 bytes
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+    const char *romanizationFile = nullptr;
+    const char *outputFile = nullptr;
+    size_t threads = 0;
+    std::vector<const char *> positional;
+    const char *mode = nullptr;
+    for (int i = 1; i < argc; i++) {
+        const bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "-r") == 0 && hasValue) {
+            romanizationFile = argv[++i];
+        } else if (std::strcmp(argv[i], "-o") == 0 && hasValue) {
+            outputFile = argv[++i];
+        } else if (std::strcmp(argv[i], "-j") == 0 && hasValue) {
+            const auto text = argv[++i];
+            char *end = nullptr;
+            errno = 0;
+            threads = std::strtoul(text, &end, 10);
+            if (text[0] < '0' || text[0] > '9' || *end != '\0' || errno != 0 || threads == 0) {
+                std::fprintf(stderr, "Expected a thread count of at least 1 after -j\n");
+                return 1;
+            }
+        } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            printUsage(argv[0]);
+            return 1;
+        } else {
+            positional.push_back(argv[i]);
+        }
+    }
+    const bool converting = positional.size() == 3 && (
+        std::strcmp(positional[0], "romanize") == 0 || std::strcmp(positional[0], "unromanize") == 0
+    );
+    if (converting) {
+        mode = positional[0];
+        romanizationFile = positional[1];
+        positional.erase(positional.begin(), positional.begin() + 2);
+    }
+    if (positional.size() != (converting ? 1 : 2)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::optional<natevolve::romanizer::Romanizer> romanizer;
+    if (romanizationFile != nullptr) {
+        const auto loaded = natevolve::romanizer::Romanizer::fromFile(romanizationFile);
+        if (natevolve::isErr(loaded)) {
+            printError(natevolve::err(loaded));
+            return 1;
+        }
+        romanizer.emplace(natevolve::ok(loaded));
+    }
+
+    std::vector<natevolve::sndwrp::SoundChange> changes;
+    if (!converting) {
+        const auto loaded = natevolve::sndwrp::SoundChange::fromFile(positional[0]);
+        if (natevolve::isErr(loaded)) {
+            printError(natevolve::err(loaded));
+            return 1;
+        }
+        changes = natevolve::ok(loaded);
+    }
+
+    natevolve::MappedFile input;
+    const auto openError = input.open(positional.back());
+    if (openError.has_value()) {
+        printError(openError.value());
+        return 1;
+    }
+
+    auto output = stdout;
+    if (outputFile != nullptr) {
+        output = std::fopen(outputFile, "wb");
+        if (output == nullptr) {
+            std::fprintf(stderr, "Failed to open '%s'\n", outputFile);
+            return 1;
+        }
+    }
+
+    bool failed = false;
+    if (converting) {
+        convert(romanizer.value(), std::strcmp(mode, "romanize") == 0, input, output, threads);
+    } else {
+        const natevolve::sndwrp::Cascade cascade(changes);
+        failed = !evolve(
+            cascade, romanizer.has_value() ? &romanizer.value() : nullptr, input, output, threads
+        );
+    }
+
+    if (std::fflush(output) != 0 || std::ferror(output)) {
+        std::fprintf(stderr, "Failed to write the output\n");
+        failed = true;
+    }
+    if (output != stdout) {
+        std::fclose(output);
+    }
+    return failed ? 1 : 0;
+}
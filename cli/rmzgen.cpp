@@ -0,0 +1,227 @@
+// Code generator that compiles a .rmz file into tables for StaticRomanizer
+
+#include <map>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cctype>
+#include <err.hpp>
+#include <natevolve.hpp>
+#include <romanizer.hpp>
+#include <staticromanizer.hpp>
+
+// Characters below this get a slot in the direct lookup array, the rest are binary searched
+static constexpr uint32_t MaxDirect = 0x3000;
+
+// Type name for a table from its file name, e.g. test/test-romanization.rmz -> TestRomanization
+static std::string tableName(const std::string &fileName) {
+    auto start = fileName.find_last_of("/\\");
+    start = start == std::string::npos ? 0 : start + 1;
+    auto end = fileName.find('.', start);
+    end = end == std::string::npos ? fileName.length() : end;
+
+    std::string name;
+    bool upper = true;
+    for (size_t i = start; i < end; i++) {
+        const auto c = static_cast<unsigned char>(fileName[i]);
+        if (!std::isalnum(c)) {
+            upper = true;
+            continue;
+        }
+        name.push_back(upper ? static_cast<char>(std::toupper(c)) : static_cast<char>(c));
+        upper = false;
+    }
+    if (name.empty() || std::isdigit(static_cast<unsigned char>(name[0]))) {
+        name = "Table" + name;
+    }
+    return name;
+}
+
+// A C++ string literal holding bytes, with octal escapes so nothing runs into the next character
+static std::string literal(const std::string &bytes) {
+    std::string out = "\"";
+    for (const auto b : bytes) {
+        const auto c = static_cast<unsigned char>(b);
+        if (c >= 0x20 && c < 0x7F && c != '"' && c != '\\' && c != '?') {
+            out.push_back(static_cast<char>(c));
+        } else {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\%03o", c);
+            out += escaped;
+        }
+    }
+    return out + "\"";
+}
+
+// Trie of romanizations with each node's children kept sorted
+struct TrieNode {
+    wchar_t ipa;
+    std::map<wchar_t, size_t> children;
+};
+
+int main(int argc, char **argv) {
+    if (argc != 3 && argc != 4) {
+        std::fprintf(stderr, "Usage: %s <romanization.rmz> <header.hpp> [<name>]\n", argv[0]);
+        return 1;
+    }
+    const auto loaded = natevolve::romanizer::Romanizer::fromFile(argv[1]);
+    if (natevolve::isErr(loaded)) {
+        std::string message;
+        const auto error = natevolve::err(loaded);
+        natevolve::encodeUtf8(error.message.data(), error.message.length(), message);
+        std::fprintf(stderr, "%s\n", message.c_str());
+        return 1;
+    }
+    const auto &romanizer = std::get<natevolve::romanizer::Romanizer>(loaded);
+    const auto name = argc == 4 ? std::string(argv[3]) : tableName(argv[1]);
+
+    // Romanizations, sorted by IPA symbol since they come from a map
+    std::wstring pool;
+    std::string poolUtf8;
+    std::vector<natevolve::romanizer::StaticIpaEntry> entries;
+    uint32_t directSize = 1;
+    for (const auto &ipaMap : romanizer.ipaToRomanization) {
+        natevolve::romanizer::StaticIpaEntry entry {
+            ipaMap.first,
+            static_cast<uint32_t>(pool.length()),
+            static_cast<uint32_t>(pool.length() + ipaMap.second.length()),
+            static_cast<uint32_t>(poolUtf8.length()), 0
+        };
+        pool.append(ipaMap.second);
+        natevolve::encodeUtf8(ipaMap.second.data(), ipaMap.second.length(), poolUtf8);
+        entry.utf8End = static_cast<uint32_t>(poolUtf8.length());
+        entries.push_back(entry);
+
+        const auto c = static_cast<uint32_t>(ipaMap.first);
+        if (c < MaxDirect && c + 1 > directSize) {
+            directSize = c + 1;
+        }
+    }
+    std::vector<uint32_t> direct(directSize, natevolve::romanizer::NoStaticEntry);
+    for (size_t i = 0; i < entries.size(); i++) {
+        const auto c = static_cast<uint32_t>(entries[i].ipa);
+        if (c < directSize) {
+            direct[c] = static_cast<uint32_t>(i);
+        }
+    }
+
+    std::vector<TrieNode> trie(1, TrieNode { 0, {} });
+    for (const auto &romMap : romanizer.romanizationToIpa) {
+        size_t node = 0;
+        for (const auto c : romMap.first) {
+            const auto found = trie[node].children.find(c);
+            if (found != trie[node].children.end()) {
+                node = found->second;
+                continue;
+            }
+            trie.push_back(TrieNode { 0, {} });
+            trie[node].children.insert({ c, trie.size() - 1 });
+            node = trie.size() - 1;
+        }
+        trie[node].ipa = romMap.second;
+    }
+
+    // Lay the children of each node out next to each other, in node order
+    std::vector<natevolve::romanizer::StaticTrieNode> nodes;
+    std::vector<natevolve::romanizer::StaticTrieEdge> edges;
+    for (const auto &node : trie) {
+        nodes.push_back(natevolve::romanizer::StaticTrieNode {
+            node.ipa,
+            static_cast<uint32_t>(edges.size()), static_cast<uint32_t>(node.children.size())
+        });
+        for (const auto &child : node.children) {
+            edges.push_back(natevolve::romanizer::StaticTrieEdge {
+                child.first, static_cast<uint32_t>(child.second)
+            });
+        }
+    }
+
+    const auto file = std::fopen(argv[2], "w");
+    if (file == nullptr) {
+        std::fprintf(stderr, "Failed to open '%s' for writing\n", argv[2]);
+        return 1;
+    }
+    std::fprintf(
+        file,
+        "// Generated by rmzgen from %s. Do not edit\n\n"
+        "#pragma once\n\n"
+        "#include <cstdint>\n"
+        "#include <staticromanizer.hpp>\n\n"
+        "namespace natevolve {\n"
+        "    namespace romanizer {\n"
+        "        namespace tables {\n"
+        "            struct %s {\n",
+        argv[1], name.c_str()
+    );
+
+    // Every array gets a trailing entry so none of them are ever empty
+    std::fprintf(file, "                static constexpr wchar_t pool[] = {");
+    for (const auto c : pool) {
+        std::fprintf(file, " 0x%X,", static_cast<unsigned>(c));
+    }
+    std::fprintf(file, " 0 };\n");
+    std::fprintf(
+        file, "                static constexpr const char *poolUtf8 = %s;\n",
+        literal(poolUtf8).c_str()
+    );
+
+    std::fprintf(
+        file, "                static constexpr uint32_t ipaCount = %zu;\n", entries.size()
+    );
+    std::fprintf(file, "                static constexpr StaticIpaEntry ipa[] = {\n");
+    for (const auto &entry : entries) {
+        std::fprintf(
+            file, "                    { 0x%X, %u, %u, %u, %u },\n",
+            static_cast<unsigned>(entry.ipa), entry.begin, entry.end,
+            entry.utf8Begin, entry.utf8End
+        );
+    }
+    std::fprintf(file, "                    { 0, 0, 0, 0, 0 }\n                };\n");
+
+    std::fprintf(file, "                static constexpr uint32_t directSize = %u;\n", directSize);
+    std::fprintf(file, "                static constexpr uint32_t direct[] = {");
+    for (size_t i = 0; i < direct.size(); i++) {
+        std::fprintf(file, i % 8 == 0 ? "\n                    " : " ");
+        if (direct[i] == natevolve::romanizer::NoStaticEntry) {
+            std::fprintf(file, "NoStaticEntry,");
+        } else {
+            std::fprintf(file, "%u,", direct[i]);
+        }
+    }
+    std::fprintf(file, "\n                    NoStaticEntry\n                };\n");
+
+    std::fprintf(file, "                static constexpr StaticTrieNode nodes[] = {\n");
+    for (const auto &node : nodes) {
+        std::fprintf(
+            file, "                    { 0x%X, %u, %u },\n",
+            static_cast<unsigned>(node.ipa), node.firstEdge, node.edgeCount
+        );
+    }
+    std::fprintf(file, "                    { 0, 0, 0 }\n                };\n");
+    std::fprintf(file, "                static constexpr StaticTrieEdge edges[] = {\n");
+    for (const auto &edge : edges) {
+        std::fprintf(
+            file, "                    { 0x%X, %u },\n",
+            static_cast<unsigned>(edge.c), edge.child
+        );
+    }
+    std::fprintf(file, "                    { 0, 0 }\n                };\n");
+
+    std::fprintf(
+        file,
+        "            };\n"
+        "        }\n\n"
+        "        using %sRomanizer = StaticRomanizer<tables::%s>;\n"
+        "    }\n"
+        "}\n",
+        name.c_str(), name.c_str()
+    );
+    if (std::ferror(file)) {
+        std::fclose(file);
+        std::fprintf(stderr, "Failed to write '%s'\n", argv[2]);
+        return 1;
+    }
+    std::fclose(file);
+    return 0;
+}
@@ -0,0 +1,88 @@
+// Memoization of whole-cascade results for lexicons with lots of repeated words
+
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <unordered_map>
+#include <err.hpp>
+#include <sndwrp.hpp>
+
+namespace natevolve {
+    namespace sndwrp {
+        // Hash of the contents of a list of changes, so a cache can tell when it has been edited
+        uint64_t fingerprint(const std::vector<SoundChange> &changes);
+
+        // Thread-safe cache in front of applyAllChanges, keyed on (fingerprint, word).
+        //
+        // Entries are spread over shards that each have their own lock and evict with the
+        // CLOCK algorithm once they're full, so memory stays bounded by capacity entries.
+        // When a different list of changes shows up, it's compiled and everything cached for the
+        // old one is dropped. Errors are cached along with results
+        struct ChangeCache {
+            // -------- Functions --------
+
+            ChangeCache(const size_t capacity = 1 << 16, const size_t shards = 16);
+
+            ChangeCache(const ChangeCache &) = delete;
+            ChangeCache &operator=(const ChangeCache &) = delete;
+
+            // Same as applyAllChanges, but remembers the result.
+            // This hashes the changes on every call to notice edits. Hot loops should compute
+            // the fingerprint once and use the overload below
+            Result<std::wstring> apply(
+                const std::wstring &word, const std::vector<SoundChange> &changes
+            );
+
+            // Same as above with a fingerprint from fingerprint(changes)
+            Result<std::wstring> apply(
+                const std::wstring &word, const std::vector<SoundChange> &changes,
+                const uint64_t changesFingerprint
+            );
+
+            // Forget everything
+            void clear(void);
+
+            size_t hitCount(void) const;
+            size_t missCount(void) const;
+
+            // -------- Members --------
+
+            struct Entry {
+                uint64_t fingerprint;
+                std::wstring word;
+                Result<std::wstring> result;
+
+                // Set on every hit, cleared as the clock hand passes
+                bool referenced;
+            };
+
+            struct Shard {
+                std::mutex lock;
+                std::unordered_map<std::wstring, size_t> index;
+                std::vector<Entry> entries;
+                size_t hand;
+            };
+
+            const size_t shardCapacity;
+            std::vector<Shard> shards;
+
+            std::atomic<size_t> hits;
+            std::atomic<size_t> misses;
+
+            // The compiled form of the most recent list of changes
+            std::mutex cascadeLock;
+            uint64_t cascadeFingerprint;
+            std::shared_ptr<const Cascade> cascade;
+
+        private:
+            std::shared_ptr<const Cascade> cascadeFor(
+                const std::vector<SoundChange> &changes, const uint64_t changesFingerprint
+            );
+        };
+    }
+}
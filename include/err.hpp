@@ -10,7 +10,8 @@ namespace natevolve {
         FileOpen,
         FileRead,
         FileFormat,
-        UnknownCategory
+        UnknownCategory,
+        OutOfRange
     };
 
     struct Error {
@@ -0,0 +1,50 @@
+// Read-only memory mapping of whole files, for inputs too big to read into memory
+
+#pragma once
+
+#include <string>
+#include <cstddef>
+#include <optional>
+#include <err.hpp>
+
+namespace natevolve {
+    // A file mapped into memory. Pages are loaded by the OS as they're touched,
+    // so even multi-GB files can be walked through without reading them in.
+    // Anything that can't be mapped, like a pipe, is read into memory instead
+    struct MappedFile {
+        // -------- Functions --------
+
+        MappedFile(void);
+        ~MappedFile(void);
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        // Map a file, unmapping whatever was mapped before
+        std::optional<Error> open(const char *const fileName);
+
+        // Unmap the file. Does nothing if nothing is mapped
+        void close(void);
+
+        // Let the OS drop the pages of [0, end) since they won't be read again,
+        // which keeps memory use flat while streaming through the file.
+        // Does nothing for a file that was read in
+        void release(const size_t end);
+
+        // -------- Members --------
+
+        // The file's contents. Null for an empty file
+        const char *data;
+        size_t size;
+
+    private:
+        // Holds the contents of a file that was read rather than mapped
+        std::string buffer;
+        bool mapped;
+
+#ifdef _WIN32
+        void *file;
+        void *mapping;
+#endif
+    };
+}
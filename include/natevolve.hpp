@@ -7,11 +7,13 @@
 #include <locale>
 #include <string>
 #include <random>
+#include <cstdint>
 #include <codecvt>
 
 namespace natevolve {
-    static std::random_device g_randDev;
-    static std::mt19937 g_rng(g_randDev());
+    // Every thread gets its own generator, seeded on first use, so nothing random is shared
+    // between threads. Being inline, it's also the same one in every translation unit
+    inline thread_local std::mt19937 g_rng(std::random_device {}());
 
     static inline void enableUtf8(void) {
 #ifdef _WIN32
@@ -32,5 +34,150 @@ namespace natevolve {
         std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
         return converter.to_bytes(src);
     }
+
+    // Decode the UTF-8 character at pos and move pos past it.
+    // A malformed byte becomes U+FFFD and only that byte is skipped
+    static inline uint32_t decodeUtf8Char(const char *const str, const size_t len, size_t &pos) {
+        const auto bytes = reinterpret_cast<const unsigned char *>(str);
+        const uint32_t lead = bytes[pos];
+        if (lead < 0x80) {
+            pos++;
+            return lead;
+        }
+
+        size_t extra = 0;
+        uint32_t c = 0;
+        uint32_t min = 0;
+        if ((lead & 0xE0) == 0xC0) {
+            extra = 1;
+            c = lead & 0x1F;
+            min = 0x80;
+        } else if ((lead & 0xF0) == 0xE0) {
+            extra = 2;
+            c = lead & 0x0F;
+            min = 0x800;
+        } else if ((lead & 0xF8) == 0xF0) {
+            extra = 3;
+            c = lead & 0x07;
+            min = 0x10000;
+        }
+        size_t used = 1;
+        while (used <= extra && pos + used < len && (bytes[pos + used] & 0xC0) == 0x80) {
+            c = (c << 6) | (bytes[pos + used] & 0x3F);
+            used++;
+        }
+        if (extra == 0 || used != extra + 1 || c < min || c > 0x10FFFF
+                || (c >= 0xD800 && c <= 0xDFFF)) {
+            pos++;
+            return 0xFFFD;
+        }
+        pos += used;
+        return c;
+    }
+
+    // Decode UTF-8 onto the end of out without going through a locale.
+    // Malformed bytes each become U+FFFD, and characters outside the BMP become surrogate pairs
+    // where wchar_t is 16 bits
+    static inline void decodeUtf8(const char *const str, const size_t len, std::wstring &out) {
+        // Every byte makes at most one wchar_t, so write straight into the string and trim after
+        const auto start = out.length();
+        out.resize(start + len);
+        auto dest = &out[start];
+        size_t i = 0;
+        while (i < len) {
+            auto c = decodeUtf8Char(str, len, i);
+            if (sizeof(wchar_t) == 2 && c >= 0x10000) {
+                c -= 0x10000;
+                *dest++ = static_cast<wchar_t>(0xD800 + (c >> 10));
+                *dest++ = static_cast<wchar_t>(0xDC00 + (c & 0x3FF));
+            } else {
+                *dest++ = static_cast<wchar_t>(c);
+            }
+        }
+        out.resize(dest - out.data());
+    }
+
+    // Encode onto the end of out, the reverse of decodeUtf8.
+    // Unpaired surrogates become U+FFFD
+    static inline void encodeUtf8(const wchar_t *const str, const size_t len, std::string &out) {
+        for (size_t i = 0; i < len; i++) {
+            auto c = static_cast<uint32_t>(str[i]);
+            if (c >= 0xD800 && c <= 0xDBFF && i + 1 < len
+                    && static_cast<uint32_t>(str[i + 1]) >= 0xDC00
+                    && static_cast<uint32_t>(str[i + 1]) <= 0xDFFF) {
+                c = 0x10000 + ((c - 0xD800) << 10) + (static_cast<uint32_t>(str[i + 1]) - 0xDC00);
+                i++;
+            } else if ((c >= 0xD800 && c <= 0xDFFF) || c > 0x10FFFF) {
+                c = 0xFFFD;
+            }
+
+            if (c < 0x80) {
+                out.push_back(static_cast<char>(c));
+            } else if (c < 0x800) {
+                out.push_back(static_cast<char>(0xC0 | (c >> 6)));
+                out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+            } else if (c < 0x10000) {
+                out.push_back(static_cast<char>(0xE0 | (c >> 12)));
+                out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+            } else {
+                out.push_back(static_cast<char>(0xF0 | (c >> 18)));
+                out.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+            }
+        }
+    }
+
+    // Whether a character belongs to the sound before it, like diacritics (ã), modifier letters
+    // (tʰ) and length marks (aː). Stress marks are left alone since they come before a syllable
+    static inline bool isJoiner(const wchar_t c) {
+        if (c < 0x02B0) {
+            return false;
+        }
+        return (c <= 0x02FF && c != 0x02C8 && c != 0x02CC)
+            || (c >= 0x0300 && c <= 0x036F)
+            || (c >= 0x1AB0 && c <= 0x1AFF)
+            || (c >= 0x1D2C && c <= 0x1D6A)
+            || (c >= 0x1DC0 && c <= 0x1DFF)
+            || c == 0x207F
+            || (c >= 0x20D0 && c <= 0x20FF)
+            || (c >= 0xDC00 && c <= 0xDFFF); // Second half of a UTF-16 surrogate pair
+    }
+
+    // Whether a character is a tie bar, which pulls the following sound in too, like d͡ʒ
+    static inline bool isTie(const wchar_t c) {
+        return c == 0x0361 || c == 0x035C;
+    }
+
+    // Whether a new sound starts at pos in an IPA string
+    static inline bool isSegmentStart(const wchar_t *const str, const size_t pos) {
+        return pos == 0 || (!isJoiner(str[pos]) && !isTie(str[pos - 1]));
+    }
+
+    // Find where the sound (segment) starting at start ends.
+    // A segment is one character plus any joiners after it, linked together by tie bars
+    static inline size_t segmentEnd(const wchar_t *const str, const size_t len, size_t start) {
+        if (start >= len) {
+            return len;
+        }
+        start++;
+        while (start < len && !isSegmentStart(str, start)) {
+            start++;
+        }
+        return start;
+    }
+
+    // Find where the segment ending at end starts
+    static inline size_t segmentStart(const wchar_t *const str, size_t end) {
+        if (end == 0) {
+            return 0;
+        }
+        end--;
+        while (!isSegmentStart(str, end)) {
+            end--;
+        }
+        return end;
+    }
 };
 
@@ -0,0 +1,91 @@
+// Counter-based random number generator for reproducible generation
+
+#pragma once
+
+#include <cstdint>
+
+namespace natevolve {
+    // Philox4x32-10 (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3").
+    // Each block of four numbers is a keyed scramble of a 128-bit counter, so there's no state
+    // to seed or carry around: any stream and any point in it can be jumped to straight away.
+    // The upper half of the counter picks the stream and the lower half counts blocks in it.
+    // Usable anywhere a standard engine is, e.g. with std::uniform_int_distribution
+    struct Philox {
+        // -------- Functions --------
+
+        using result_type = uint32_t;
+
+        static constexpr result_type min(void) {
+            return 0;
+        }
+
+        static constexpr result_type max(void) {
+            return UINT32_MAX;
+        }
+
+        Philox(const uint64_t key, const uint64_t stream = 0):
+                key { static_cast<uint32_t>(key), static_cast<uint32_t>(key >> 32) },
+                counter {
+                    0, 0, static_cast<uint32_t>(stream), static_cast<uint32_t>(stream >> 32)
+                },
+                used(4) {}
+
+        result_type operator()(void) {
+            if (used == 4) {
+                refill();
+            }
+            return block[used++];
+        }
+
+        // Jump to the start of block n of the stream
+        void seek(const uint64_t n) {
+            counter[0] = static_cast<uint32_t>(n);
+            counter[1] = static_cast<uint32_t>(n >> 32);
+            used = 4;
+        }
+
+        // Scramble one counter with a key, as in the paper's known-answer tests
+        static void scramble(const uint32_t in[4], const uint32_t inKey[2], uint32_t out[4]) {
+            uint32_t c[4] = { in[0], in[1], in[2], in[3] };
+            uint32_t k[2] = { inKey[0], inKey[1] };
+            for (int round = 0; round < 10; round++) {
+                const auto mul0 = static_cast<uint64_t>(0xD2511F53) * c[0];
+                const auto mul1 = static_cast<uint64_t>(0xCD9E8D57) * c[2];
+                const uint32_t next[4] = {
+                    static_cast<uint32_t>(mul1 >> 32) ^ c[1] ^ k[0],
+                    static_cast<uint32_t>(mul1),
+                    static_cast<uint32_t>(mul0 >> 32) ^ c[3] ^ k[1],
+                    static_cast<uint32_t>(mul0)
+                };
+                c[0] = next[0];
+                c[1] = next[1];
+                c[2] = next[2];
+                c[3] = next[3];
+                k[0] += 0x9E3779B9;
+                k[1] += 0xBB67AE85;
+            }
+            out[0] = c[0];
+            out[1] = c[1];
+            out[2] = c[2];
+            out[3] = c[3];
+        }
+
+        // -------- Members --------
+
+        uint32_t key[2];
+        uint32_t counter[4];
+
+        // The current block and how many of its numbers have been handed out
+        uint32_t block[4];
+        uint32_t used;
+
+    private:
+        void refill(void) {
+            scramble(counter, key, block);
+            if (++counter[0] == 0) {
+                counter[1]++;
+            }
+            used = 0;
+        }
+    };
+}
@@ -0,0 +1,155 @@
+// Generating, evolving and romanizing words in one pass
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <optional>
+#include <unordered_set>
+#include <err.hpp>
+#include <pool.hpp>
+#include <wordup.hpp>
+#include <sndwrp.hpp>
+#include <romanizer.hpp>
+
+namespace natevolve {
+    // Conditions that turn a word away at one stage of a Pipeline
+    struct Filter {
+        // -------- Functions --------
+
+        // Whether the word breaks the length limits or contains something blacklisted
+        bool rejects(const std::wstring &word) const;
+
+        // -------- Members --------
+
+        // Limits on the number of sounds, counting a character along with its diacritics
+        size_t minLength = 0;
+        size_t maxLength = SIZE_MAX;
+
+        // Words containing any of these are rejected
+        std::vector<std::wstring> blacklist;
+
+        // Reject words whose form at this stage is the same as a word the pipeline already gave.
+        // This is checked in word order once the whole batch has been through every stage, so
+        // the result doesn't depend on timing. Words it turns away have still been evolved and
+        // romanized, so prefer the other conditions for anything that rejects a lot of words
+        bool homophones = false;
+    };
+
+    // How much work one stage of a Pipeline has done so far
+    struct StageStats {
+        // -------- Functions --------
+
+        // Words handled per second of work. Time is added up over every worker,
+        // so this is the rate of a single thread
+        double wordsPerSecond(void) const;
+
+        // -------- Members --------
+
+        // Words that reached the stage and how many of them it turned away
+        size_t words = 0;
+        size_t rejected = 0;
+
+        uint64_t nanoseconds = 0;
+    };
+
+    // The words a Pipeline accepted from one batch, each in all three forms.
+    // Word i of every arena is the same word
+    struct PipelineBatch {
+        // -------- Members --------
+
+        wordup::WordArena proto;
+        wordup::WordArena evolved;
+        wordup::WordArena romanized;
+
+        // Where each word came from, so Generator::generateAt(seed, index) redoes it
+        std::vector<uint64_t> indices;
+    };
+
+    // Runs new words through generation, sound changes and romanization, with a filter after
+    // each. Words are handled in batches on a Pool, and every chunk of a batch goes through
+    // one stage at a time in buffers that are kept from batch to batch, so once they've grown
+    // nothing is allocated per word.
+    //
+    // Word k is always drawn the same way for a seed, and homophones are checked in word order
+    // once a batch is done, so the output doesn't depend on the number of threads
+    struct Pipeline {
+        // -------- Functions --------
+
+        // Stages given as null are skipped, passing words through unchanged.
+        // Everything given has to outlive the pipeline. Without a seed, one is picked at random
+        Pipeline(
+            const wordup::Generator &gen,
+            const sndwrp::Cascade *const cascade = nullptr,
+            const romanizer::Romanizer *const romanization = nullptr,
+            const std::optional<uint64_t> seed = std::nullopt,
+            const size_t batchSize = 1 << 16
+        );
+
+        // Run the next batchSize words through every stage, overwriting out with the ones that
+        // made it. If generating or evolving a word fails, the first such error is returned
+        std::optional<Error> next(PipelineBatch &out, Pool &pool);
+
+        // -------- Members --------
+
+        const wordup::Generator &gen;
+        const sndwrp::Cascade *const cascade;
+        const romanizer::Romanizer *const romanization;
+
+        const uint64_t seed;
+        const size_t batchSize;
+
+        // Index of the first word of the next batch
+        uint64_t first;
+
+        // Applied after generating, evolving and romanizing respectively
+        Filter protoFilter;
+        Filter evolvedFilter;
+        Filter romanizedFilter;
+
+        // Totals over every batch so far. A homophone counts as rejected by the stage whose
+        // filter caught it, though it's caught in collect: the homophone check and copy into
+        // the batch, done on one thread, which rejects nothing of its own
+        struct Stats {
+            StageStats generate;
+            StageStats evolve;
+            StageStats romanize;
+            StageStats collect;
+        };
+        Stats stats;
+
+        // Hashes of every form given out so far, for filters that reject homophones.
+        // A collision can throw away a new word but never let a homophone through
+        std::unordered_set<uint64_t> seenProto;
+        std::unordered_set<uint64_t> seenEvolved;
+        std::unordered_set<uint64_t> seenRomanized;
+
+        // The words left in one chunk of a batch, in the same order as they were generated.
+        // Only the first size entries are in use; the rest are kept for their storage
+        struct Part {
+            std::vector<std::wstring> proto;
+            std::vector<std::wstring> evolved;
+            std::vector<std::wstring> romanized;
+            std::vector<uint64_t> indices;
+            size_t size;
+
+            Stats stats;
+            std::optional<Error> error;
+        };
+        std::vector<Part> parts;
+
+        // One per worker
+        std::vector<sndwrp::Workspace> workspaces;
+
+    private:
+        // Send words [begin, end) through every stage into part
+        void runChunk(
+            const uint64_t begin, const uint64_t end, Part &part, sndwrp::Workspace &workspace
+        ) const;
+
+        // Whether the word at j of part is a homophone of one given out already, counting it
+        // against the stage that caught it. Remembers the word if not
+        bool isHomophone(const Part &part, const size_t j);
+    };
+}
@@ -0,0 +1,77 @@
+// Thread pool used by the batch APIs of every module
+
+#pragma once
+
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+
+namespace natevolve {
+    // A fixed set of worker threads that each own a queue of tasks.
+    // Workers take from the back of their own queue and steal from the front of the others
+    // when they run out, so uneven batches still keep every core busy
+    struct Pool {
+        // -------- Functions --------
+
+        // Start the workers. 0 means one per hardware thread
+        Pool(const size_t threads = 0);
+        ~Pool(void);
+
+        Pool(const Pool &) = delete;
+        Pool &operator=(const Pool &) = delete;
+
+        // Split [0, count) into chunks of at most grain items and run task(begin, end, worker)
+        // on each, returning once all of them are done. The calling thread helps out.
+        // worker is below workers(), so it can index per-worker scratch space.
+        // Only one thread outside of the pool should call this at a time
+        void parallelFor(
+            const size_t count, const size_t grain,
+            const std::function<void(size_t, size_t, size_t)> &task
+        );
+
+        // Number of distinct worker indices passed to tasks, including the calling thread
+        size_t workers(void) const;
+
+        // -------- Members --------
+
+        struct Job {
+            const std::function<void(size_t, size_t, size_t)> *task;
+            std::atomic<size_t> remaining;
+        };
+
+        struct Task {
+            Job *job;
+            size_t begin;
+            size_t end;
+        };
+
+        struct Queue {
+            std::mutex lock;
+            std::deque<Task> tasks;
+        };
+
+        std::vector<std::thread> threads;
+        std::vector<Queue> queues;
+
+        // Number of tasks sitting in any queue
+        std::atomic<size_t> queued;
+
+        // Idle workers sleep on this
+        std::mutex sleepLock;
+        std::condition_variable wake;
+        bool stopping;
+
+        // Callers of parallelFor wait on this
+        std::mutex doneLock;
+        std::condition_variable done;
+
+    private:
+        void work(const size_t worker);
+        bool take(const size_t worker, Task &task);
+        void run(const Task &task, const size_t worker);
+    };
+}
@@ -0,0 +1,87 @@
+// Running Soundwarp cascades backwards to find the forms a word could have come from
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <unordered_set>
+#include <sndwrp.hpp>
+
+namespace natevolve {
+    namespace sndwrp {
+        // Enumerates every ancestral form that a list of changes turns into a given word.
+        //
+        // Changes are undone one at a time from the last. Undoing a change can only turn its
+        // result sound back into its target where the conditions held, so each change is an
+        // inverse lookup, and changes whose sounds aren't in the word are passed straight over.
+        // Ancestors are found depth first and handed out one at a time by next, so a huge set
+        // of candidates never exists in memory all at once.
+        //
+        // An optional proto-inventory (e.g. from wordup::Generator::inventory) limits what the
+        // oldest form may contain. Before each change only sounds that inventory can evolve into
+        // are allowed, which cuts off dead branches early
+        struct Reconstructor {
+            // -------- Functions --------
+
+            // An empty protoSounds allows any sound.
+            // Sounds spanning several segments, like the diphthong ai, allow each segment
+            Reconstructor(
+                const std::vector<SoundChange> &changes,
+                const std::vector<std::wstring> &protoSounds = {}
+            );
+
+            // Begin enumerating the ancestors of word, dropping any enumeration in progress
+            void start(const std::wstring &word);
+
+            // Write the next ancestor into out. Gives false once there are no more
+            bool next(std::wstring &out);
+
+            // -------- Members --------
+
+            const Cascade cascade;
+
+            // Whether there's a proto-inventory at all
+            bool constrained;
+
+            // reachable[i] is a bitset of the sound ids that can be in a word right before
+            // change i, and reachable[changes] after all of them
+            std::vector<std::vector<uint64_t>> reachable;
+
+            // Proto-inventory segments the changes never mention, which they pass through as is
+            std::unordered_set<std::wstring> otherSounds;
+
+            // touching[id] lists, in order, the changes that have sound id as their target or
+            // result, so finding the next change to undo only looks at the word's own sounds
+            std::vector<std::vector<uint32_t>> touching;
+
+            // One change being undone. ids is a candidate for the word before that change,
+            // built up one sound at a time and backtracked through
+            struct Frame {
+                size_t change;
+                std::vector<uint16_t> target;
+                std::vector<uint16_t> ids;
+
+                // Which option to try next at each position: 0 is the same sound, 1 the target
+                std::vector<uint8_t> options;
+                size_t pos;
+            };
+
+            // The word being reconstructed, its ids, and the current path of undone changes
+            std::wstring word;
+            std::vector<uint16_t> wordIds;
+            std::vector<Frame> frames;
+            size_t depth;
+
+            // Set when no change touches the word, so it's its own only ancestor
+            bool pendingWord;
+
+        private:
+            bool allowed(const size_t change, const uint16_t id) const;
+            bool consistent(const Frame &frame, const size_t pos) const;
+            bool advance(Frame &frame);
+            void push(const size_t change, const std::vector<uint16_t> &target);
+            size_t skipUntouched(size_t change, const std::vector<uint16_t> &ids) const;
+        };
+    }
+}
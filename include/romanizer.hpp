@@ -4,7 +4,12 @@
 
 #include <map>
 #include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
 #include <err.hpp>
+#include <pool.hpp>
 
 namespace natevolve {
     namespace romanizer {
@@ -26,10 +31,35 @@ namespace natevolve {
             // Unknown symbols are left alone as an assumption they are 1:1 between Rom. and IPA
             std::wstring romanize(const std::wstring &ipaWord) const;
 
+            // Same as above, but write into a caller-owned buffer, reusing its storage
+            void romanize(const std::wstring &ipaWord, std::wstring &romWord) const;
+
+            // Same as above for UTF-8 text, appending to romWord.
+            // Runs of ASCII with no romanization are copied over in bulk
+            void romanize(const std::string_view ipaWord, std::string &romWord) const;
+
             // Convert a word written in the Romanization to its IPA pronunciation.
+            // Where several romanizations match, the longest one wins, so <sh> beats <s>.
             // Unknown symbols are left alone as an assumption they are 1:1 between Rom. and IPA
             std::wstring unromanize(const std::wstring &romWord) const;
 
+            // Same as above for UTF-8 text, appending to ipaWord
+            void unromanize(const std::string_view romWord, std::string &ipaWord) const;
+
+            // Romanize a whole UTF-8 text on a Pool, appending to out.
+            // The text is split into chunks at safeSplit boundaries, so the result is
+            // byte for byte what one romanize call would give
+            void romanizeCorpus(const std::string_view text, std::string &out, Pool &pool) const;
+
+            // Same as above for unromanizing
+            void unromanizeCorpus(const std::string_view text, std::string &out, Pool &pool) const;
+
+            // First position at or after pos where text can be cut in two and each half converted
+            // on its own without changing the result, or text.length() if there's none.
+            // Any character boundary works when romanizing. Unromanizing cuts after whitespace
+            // that's in no romanization, since a multigraph can never span it
+            size_t safeSplit(const std::string_view text, size_t pos, const bool romanizing) const;
+
             // -------- Members --------
 
             // What special IPA symbols are mapped to what characters in a Romanization
@@ -37,6 +67,55 @@ namespace natevolve {
 
             // The reverse of above to simplify code and speed up conversions
             const std::map<std::wstring, wchar_t> romanizationToIpa;
+
+            // Where an IPA symbol's romanization is in romPool and romPoolUtf8
+            struct Span {
+                uint32_t begin;
+                uint32_t end;
+                uint32_t utf8Begin;
+                uint32_t utf8End;
+            };
+
+            // Every romanization back to back, so looking one up never touches the map
+            std::wstring romPool;
+            std::string romPoolUtf8;
+
+            // Bit c is set if ASCII character c has a romanization
+            uint64_t asciiMapped[2];
+
+            // Bit c is set if some romanization starts with ASCII character c
+            uint64_t asciiRomStart[2];
+
+            // ipaToRomanization indexed directly by BMP character. Characters past the end of the
+            // table or with begin == UnmappedSpan have no romanization
+            std::vector<Span> ipaTable;
+
+            // The rest of ipaToRomanization, for characters outside the BMP
+            std::unordered_map<wchar_t, Span> ipaOther;
+
+            static constexpr uint32_t UnmappedSpan = UINT32_MAX;
+
+            // romanizationToIpa as a trie with one node per prefix, built on construction so
+            // unromanizing walks it instead of comparing against every entry.
+            // romNodeIpa is the IPA symbol for the romanization ending at a node, or 0 if none.
+            // Node 0 is the root
+            std::vector<wchar_t> romNodeIpa;
+
+            // First level of the trie, indexed directly by BMP character
+            std::vector<uint32_t> romTable;
+
+            // Every other edge, keyed by (node << 32) | character
+            std::unordered_map<uint64_t, uint32_t> romEdges;
+
+        private:
+            // Child of node for c, or 0 if there isn't one
+            uint32_t romChild(const uint32_t node, const wchar_t c) const;
+
+            // Same as above for a whole code point, which can be two wchar_ts on Windows
+            uint32_t romChild(uint32_t node, const uint32_t codePoint) const;
+
+            // Romanization span of an IPA code point, or nullptr if it has none
+            const Span *ipaSpan(const uint32_t codePoint) const;
         };
     }
 }
@@ -0,0 +1,67 @@
+// Incremental re-evolution of a lexicon while its sound changes are being edited
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <optional>
+#include <err.hpp>
+#include <sndwrp.hpp>
+
+namespace natevolve {
+    namespace sndwrp {
+        // A lexicon evolved through a list of changes, along with snapshots of every word at
+        // checkpoint changes. Editing one change only redoes the work from the nearest
+        // checkpoint before it, and stops early for every word the edit doesn't affect.
+        //
+        // Snapshots are taken every `interval` changes, picked so they fit in maxSnapshotBytes
+        struct Session {
+            // -------- Functions --------
+
+            // Evolve every word once and take the initial snapshots
+            static Result<Session> create(
+                const std::vector<std::wstring> &words,
+                const std::vector<SoundChange> &changes,
+                const size_t maxSnapshotBytes = 64 << 20
+            );
+
+            // Replace the change at index and re-evolve whatever it affects.
+            // Gives back how many words ended up with a different result
+            Result<size_t> setChange(const size_t index, const SoundChange &change);
+
+            // -------- Members --------
+
+            // The original words
+            std::vector<std::wstring> words;
+
+            // The current list of changes
+            std::vector<SoundChange> changes;
+
+            // Each word after all changes, in the same order as words
+            std::vector<std::wstring> evolved;
+
+            // Number of changes between snapshots
+            size_t interval;
+
+            // snapshots[i][w] is word w right before change (i + 1) * interval.
+            // The words themselves serve as the snapshot before change 0
+            std::vector<std::vector<std::wstring>> snapshots;
+
+        private:
+            Session(
+                const std::vector<std::wstring> &words, const std::vector<SoundChange> &changes,
+                const size_t interval
+            );
+
+            // Form of word w right before change index, for index a multiple of interval
+            std::wstring &checkpoint(const size_t index, const size_t w);
+
+            // Apply changes [first, last) to word, using scratch as the second buffer
+            std::optional<Error> run(
+                const size_t first, const size_t last, std::wstring &word
+            );
+
+            std::wstring scratch;
+        };
+    }
+}
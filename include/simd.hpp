@@ -0,0 +1,80 @@
+// Vectorized search kernels shared by the modules
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace natevolve {
+    namespace simd {
+        // Runs shorter than this are searched in place instead of going through dispatch
+        constexpr size_t ShortRun = 16;
+
+        // Index of the first val in [from, len) of an array of 32-bit or 16-bit units, or len
+        // if there is none. The units are read as bytes, so data can be any type of that size,
+        // like wchar_t. These pick the widest vector unit the CPU has the first time they're used
+        size_t findWide32(
+            const void *const data, const size_t len, size_t from, const uint32_t val
+        );
+        size_t findWide16(
+            const void *const data, const size_t len, size_t from, const uint16_t val
+        );
+
+        // Index of the first byte in [from, len) of data that isn't ASCII, or len if they all are
+        size_t findNonAsciiWide(const char *const data, const size_t len, size_t from);
+
+        // Name of the kernel picked for this CPU, e.g. "avx2"
+        const char *kernelName(void);
+
+        // One set of the kernels above, all written for the same vector unit
+        struct Kernels {
+            size_t (*find32)(const void *const, const size_t, size_t, const uint32_t);
+            size_t (*find16)(const void *const, const size_t, size_t, const uint16_t);
+            size_t (*nonAscii)(const char *const, const size_t, size_t);
+            const char *name;
+        };
+
+        // Every set of kernels this CPU can run, widest first and ending with the scalar one,
+        // so they can be checked against each other. The functions above use the first
+        const std::vector<Kernels> &supportedKernels(void);
+
+        template <typename T>
+        static inline size_t findScalar(
+                const T *const data, const size_t len, size_t from, const T val) {
+            while (from < len && data[from] != val) {
+                from++;
+            }
+            return from;
+        }
+
+        static inline size_t find(
+                const uint16_t *const data, const size_t len,
+                const size_t from, const uint16_t val) {
+            return len - from < ShortRun
+                ? findScalar(data, len, from, val) : findWide16(data, len, from, val);
+        }
+
+        static inline size_t find(
+                const wchar_t *const data, const size_t len, const size_t from, const wchar_t val) {
+            if (len - from < ShortRun) {
+                return findScalar(data, len, from, val);
+            }
+            if constexpr (sizeof(wchar_t) == sizeof(uint32_t)) {
+                return findWide32(data, len, from, static_cast<uint32_t>(val));
+            } else {
+                return findWide16(data, len, from, static_cast<uint16_t>(val));
+            }
+        }
+
+        static inline size_t findNonAscii(const char *const data, const size_t len, size_t from) {
+            if (len - from < ShortRun) {
+                while (from < len && static_cast<unsigned char>(data[from]) < 0x80) {
+                    from++;
+                }
+                return from;
+            }
+            return findNonAsciiWide(data, len, from);
+        }
+    }
+}
@@ -4,11 +4,21 @@
 
 #include <vector>
 #include <variant>
+#include <string>
+#include <cstdint>
+#include <utility>
+#include <optional>
+#include <unordered_map>
 #include <err.hpp>
+#include <pool.hpp>
 
 namespace natevolve {
     namespace sndwrp {
         // Represents a mapping of a > b / X_X
+        //
+        // Sounds are IPA segments rather than single characters: a character plus any diacritics
+        // or modifier letters after it, joined with the next one by a tie bar. So d͡ʒ, tʰ and aː
+        // are each one sound, and a change to d won't touch the d in d͡ʒ
         struct SoundChange {
             // -------- Functions --------
 
@@ -17,32 +27,51 @@ namespace natevolve {
             // File format is lines of the following syntax:
             // <sound> '>' <sound> '/' '{' { <sound> | '#' } '}' '_' '{' { <sound> | '#' } '}'
             // Ex: f>v/{#}_{}
+            // Ex: d͡ʒ>ʒ/{aiu}_{}
+            // The file is read as UTF-8. If anything is wrong, every problem found is reported
             static Result<std::vector<SoundChange>> fromFile(const char *const fileName);
 
+            // Same as above, but instead of failing add each problem (with its line and column)
+            // to errors and give back the changes on every line that did parse
+            static std::vector<SoundChange> fromFile(
+                const char *const fileName, std::vector<Error> &errors
+            );
+
+            SoundChange(
+                const std::wstring &ca, const std::wstring &cb,
+                const std::vector<std::wstring> &fCond, const std::vector<std::wstring> &eCond
+            );
+
+            // Same as above, taking over the strings instead of copying them
             SoundChange(
-                const wchar_t ca, const wchar_t cb,
-                const std::vector<wchar_t> &fCond, const std::vector<wchar_t> &eCond
+                std::wstring &&ca, std::wstring &&cb,
+                std::vector<std::wstring> &&fCond, std::vector<std::wstring> &&eCond
             );
 
             // Given a word in IPA format, apply this sound change to it
             Result<std::wstring> apply(const std::wstring &word) const;
 
+            // Same as above, but write the changed word into a caller-owned buffer.
+            // The buffer's storage is reused, so nothing is allocated once it is big enough.
+            // out must not be the same string as word
+            std::optional<Error> apply(const std::wstring &word, std::wstring &out) const;
+
             // -------- Members ---------
 
             // The sound to identify
-            const wchar_t a;
+            const std::wstring a;
 
             // The sound to replace it with. For things like apocope, use ∅
-            const wchar_t b;
+            const std::wstring b;
 
             // The set of front sounds that can trigger this change.
             // Empty list ignores front condition while # represents word initial boundary
-            // Something like all vowels would be { L'a', L'i', L'u' }
+            // Something like all vowels would be { L"a", L"i", L"u" }
             // or whatever vowels exist in the lang
-            const std::vector<wchar_t> frntCond;
+            const std::vector<std::wstring> frntCond;
 
             // Same thing as above but for post-context
-            const std::vector<wchar_t> endCond;
+            const std::vector<std::wstring> endCond;
         };
 
         // Given a set of changes, apply each one in order
@@ -50,6 +79,211 @@ namespace natevolve {
             const std::wstring &word,
             const std::vector<SoundChange> &changes
         );
+
+        // Same as above, but alternate between two caller-owned buffers instead of creating a
+        // new string for every change. The result ends up in out.
+        // Neither buffer may be the same string as word
+        std::optional<Error> applyAllChanges(
+            const std::wstring &word,
+            const std::vector<SoundChange> &changes,
+            std::wstring &out, std::wstring &scratch
+        );
+
+        // Interns every sound mentioned by a set of changes as a small, dense id
+        // so compiled rules can work on arrays of ids and use lookup tables instead of scanning.
+        // Id 0 stands for any sound the changes never mention
+        struct Inventory {
+            // -------- Functions --------
+
+            Inventory(const std::vector<SoundChange> &changes);
+
+            // Get the id of a sound, or 0 if it isn't part of the inventory
+            uint16_t idOf(const std::wstring &sound) const;
+
+            // Same as above for the sound in str[0, len), walking the sound trie
+            uint16_t idOf(const wchar_t *const str, const size_t len) const;
+
+            // Split a word into sounds and convert it into one id per sound.
+            // A word is cut at segment boundaries (see SoundChange) and each segment is looked up
+            // whole, rather than taking the longest inventory sound at each position. The .sw
+            // format already reads {aiu} as three sounds, so a sound spanning several segments,
+            // like the Wordup vowel ai, can't be written in a change. Such a sound passed to the
+            // constructor is interned but never matched
+            void tokenize(const std::wstring &word, std::vector<uint16_t> &ids) const;
+
+            // Convert ids back into a word. Sounds with id 0 are copied from the source word,
+            // which must be the word the ids were tokenized from
+            void detokenize(
+                const std::vector<uint16_t> &ids, const std::wstring &source, std::wstring &word
+            ) const;
+
+            // -------- Members --------
+
+            // The sound each id stands for. Index 0 is unused
+            std::vector<std::wstring> sounds;
+
+            // Trie of every sound, one node per prefix. Node 0 is the root.
+            // nodeIds gives the id of the sound ending at a node, or 0 for none
+            std::vector<uint16_t> nodeIds;
+
+            // First level of the trie, indexed directly by BMP character
+            std::vector<uint32_t> table;
+
+            // Every other edge, keyed by (node << 32) | character
+            std::unordered_map<uint64_t, uint32_t> edges;
+        };
+
+        // A SoundChange resolved against an Inventory.
+        // Both contexts are bitsets indexed by sound id stored in the owning Cascade
+        struct CompiledChange {
+            // -------- Members --------
+
+            uint16_t a;
+            uint16_t b;
+
+            // Empty conditions always pass
+            bool frntAny;
+            bool endAny;
+
+            // Whether '#' (word boundary) is in the condition
+            bool frntBoundary;
+            bool endBoundary;
+
+            // Offsets of the condition bitsets in Cascade::bits
+            size_t frntBits;
+            size_t endBits;
+        };
+
+        // Reusable buffers for applying a Cascade without allocating
+        struct Workspace {
+            // -------- Members --------
+
+            std::vector<uint16_t> ids;
+
+            // How many times each sound id is in the word being changed.
+            // Kept up to date as changes fire, and all zero between words
+            std::vector<uint32_t> counts;
+        };
+
+        // Which changes fired on a word and where, for showing its derivation later.
+        // Sounds never split or merge, so a position stays valid through the whole cascade
+        struct Trace {
+            // -------- Functions --------
+
+            // Forget the previous word, keeping the storage
+            void clear(void);
+
+            // Whether change ever rewrote a sound
+            bool hasFired(const size_t change) const;
+
+            // -------- Members --------
+
+            // One rewrite: change replaced the sound at position (counted in sounds, not chars)
+            struct Step {
+                uint32_t change;
+                uint32_t position;
+            };
+
+            // Bit i is set if change i fired at least once
+            std::vector<uint64_t> fired;
+
+            // Every rewrite in the order it happened
+            std::vector<Step> steps;
+        };
+
+        // Traces for a whole batch of words, stored back to back instead of one Trace per word
+        struct TraceArena {
+            // -------- Functions --------
+
+            // Number of words traced
+            size_t size(void) const;
+
+            // Whether change fired on word
+            bool hasFired(const size_t word, const size_t change) const;
+
+            // The rewrites made to word are [stepsBegin(word), stepsEnd(word))
+            const Trace::Step *stepsBegin(const size_t word) const;
+            const Trace::Step *stepsEnd(const size_t word) const;
+
+            // -------- Members --------
+
+            // Number of 64-bit words in each word's fired bitset
+            size_t setWords;
+
+            // The fired bitset of word w starts at w * setWords
+            std::vector<uint64_t> fired;
+
+            // Every word's rewrites. Those of word w are [stepOffsets[w], stepOffsets[w + 1])
+            std::vector<Trace::Step> steps;
+            std::vector<size_t> stepOffsets;
+        };
+
+        // A list of sound changes compiled once so applying them does constant work per sound
+        struct Cascade {
+            // -------- Functions --------
+
+            Cascade(const std::vector<SoundChange> &changes);
+
+            // Same as applyAllChanges on the changes this was compiled from
+            Result<std::wstring> apply(const std::wstring &word) const;
+
+            // Same as above, but write into out using buffers from a Workspace.
+            // Once the buffers have grown to fit, this doesn't allocate.
+            // If trace isn't null, it's cleared and filled in with every rewrite
+            std::optional<Error> apply(
+                const std::wstring &word, std::wstring &out, Workspace &workspace,
+                Trace *const trace = nullptr
+            ) const;
+
+            // Apply every change in order to the tokenized word in workspace.ids, in place.
+            // A change whose target sound isn't in the word is skipped without looking at it
+            void applyIds(Workspace &workspace, Trace *const trace = nullptr) const;
+
+            // Replay a trace of word, giving the word after each change that fired on it
+            // along with that change's index
+            std::vector<std::pair<size_t, std::wstring>> derivation(
+                const std::wstring &word,
+                const Trace::Step *const stepsBegin, const Trace::Step *const stepsEnd
+            ) const;
+
+            // -------- Members --------
+
+            Inventory inventory;
+            std::vector<CompiledChange> changes;
+
+            // Number of 64-bit words in each condition bitset
+            size_t setWords;
+
+            // Storage for every condition bitset
+            std::vector<uint64_t> bits;
+        };
+
+        // Apply a compiled cascade. Gives the same result as the vector version
+        Result<std::wstring> applyAllChanges(const std::wstring &word, const Cascade &cascade);
+
+        // Apply a compiled cascade into a caller-owned buffer, optionally tracing it
+        std::optional<Error> applyAllChanges(
+            const std::wstring &word, const Cascade &cascade,
+            std::wstring &out, Workspace &workspace, Trace *const trace = nullptr
+        );
+
+        // Evolve a whole lexicon on a Pool. Results are in the same order as the words,
+        // and a word that fails doesn't stop the rest of the batch
+        std::vector<Result<std::wstring>> applyToLexicon(
+            const std::wstring *const words, const size_t count,
+            const Cascade &cascade, Pool &pool
+        );
+
+        // Same as above, also tracing every word into traces, which is overwritten
+        std::vector<Result<std::wstring>> applyToLexicon(
+            const std::wstring *const words, const size_t count,
+            const Cascade &cascade, Pool &pool, TraceArena &traces
+        );
+
+        // Same as above, compiling the changes first
+        std::vector<Result<std::wstring>> applyToLexicon(
+            const std::vector<std::wstring> &words,
+            const std::vector<SoundChange> &changes, Pool &pool
+        );
     }
 }
-
@@ -0,0 +1,205 @@
+// Romanizer over tables compiled into the program by rmzgen
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <natevolve.hpp>
+
+namespace natevolve {
+    namespace romanizer {
+        // An IPA symbol and where its romanization is in a table's pools
+        struct StaticIpaEntry {
+            wchar_t ipa;
+            uint32_t begin;
+            uint32_t end;
+            uint32_t utf8Begin;
+            uint32_t utf8End;
+        };
+
+        // A node of the romanization trie. Its children are edges[firstEdge, firstEdge + edgeCount),
+        // sorted by character. ipa is 0 if no romanization ends here
+        struct StaticTrieNode {
+            wchar_t ipa;
+            uint32_t firstEdge;
+            uint32_t edgeCount;
+        };
+
+        struct StaticTrieEdge {
+            wchar_t c;
+            uint32_t child;
+        };
+
+        // Value in a table's direct array for characters with no romanization
+        constexpr uint32_t NoStaticEntry = UINT32_MAX;
+
+        // Same interface as Romanizer, but over a table generated from a .rmz file by rmzgen,
+        // so there's nothing to load or parse at startup and the lookups can be specialized
+        // for the table. Table provides:
+        // - pool, poolUtf8: every romanization back to back, as wchar_ts and as UTF-8
+        // - ipa[ipaCount]: StaticIpaEntry sorted by IPA symbol
+        // - direct[directSize]: index into ipa for each character below directSize
+        // - nodes, edges: the romanization trie, with node 0 as the root
+        template <typename Table>
+        struct StaticRomanizer {
+            // -------- Functions --------
+
+            // Convert a word written with IPA symbols into the Romanization.
+            // Unknown symbols are left alone as an assumption they are 1:1 between Rom. and IPA
+            std::wstring romanize(const std::wstring &ipaWord) const {
+                std::wstring romWord;
+                romanize(ipaWord, romWord);
+                return romWord;
+            }
+
+            // Same as above, but write into a caller-owned buffer, reusing its storage
+            void romanize(const std::wstring &ipaWord, std::wstring &romWord) const {
+                romWord.clear();
+                romWord.reserve(ipaWord.length());
+                for (const auto c : ipaWord) {
+                    const auto entry = lookup(static_cast<uint32_t>(c));
+                    if (entry == nullptr) {
+                        romWord.push_back(c);
+                    } else {
+                        romWord.append(Table::pool + entry->begin, entry->end - entry->begin);
+                    }
+                }
+            }
+
+            // Same as above for UTF-8 text, appending to romWord
+            void romanize(const std::string_view ipaWord, std::string &romWord) const {
+                const auto data = ipaWord.data();
+                const auto len = ipaWord.length();
+                romWord.reserve(romWord.length() + len);
+                size_t i = 0;
+                while (i < len) {
+                    const auto start = i;
+                    const auto entry = lookup(decodeUtf8Char(data, len, i));
+                    if (entry == nullptr) {
+                        romWord.append(data + start, i - start);
+                    } else {
+                        romWord.append(
+                            Table::poolUtf8 + entry->utf8Begin, entry->utf8End - entry->utf8Begin
+                        );
+                    }
+                }
+            }
+
+            // Convert a word written in the Romanization to its IPA pronunciation.
+            // Where several romanizations match, the longest one wins
+            std::wstring unromanize(const std::wstring &romWord) const {
+                std::wstring ipaWord;
+                ipaWord.reserve(romWord.length());
+                const auto len = romWord.length();
+                size_t i = 0;
+                while (i < len) {
+                    uint32_t node = 0;
+                    wchar_t ipa = 0;
+                    size_t matchEnd = i;
+                    for (size_t j = i; j < len; j++) {
+                        node = child(node, romWord[j]);
+                        if (node == 0) {
+                            break;
+                        }
+                        if (Table::nodes[node].ipa != 0) {
+                            ipa = Table::nodes[node].ipa;
+                            matchEnd = j + 1;
+                        }
+                    }
+                    if (ipa != 0) {
+                        ipaWord.push_back(ipa);
+                        i = matchEnd;
+                    } else {
+                        ipaWord.push_back(romWord[i]);
+                        i++;
+                    }
+                }
+                return ipaWord;
+            }
+
+            // Same as above for UTF-8 text, appending to ipaWord
+            void unromanize(const std::string_view romWord, std::string &ipaWord) const {
+                const auto data = romWord.data();
+                const auto len = romWord.length();
+                ipaWord.reserve(ipaWord.length() + len);
+                size_t i = 0;
+                while (i < len) {
+                    uint32_t node = 0;
+                    wchar_t ipa = 0;
+                    size_t matchEnd = i;
+                    auto next = i;
+                    while (next < len) {
+                        auto c = decodeUtf8Char(data, len, next);
+                        if (sizeof(wchar_t) == 2 && c >= 0x10000) {
+                            c -= 0x10000;
+                            node = child(node, static_cast<wchar_t>(0xD800 + (c >> 10)));
+                            c = 0xDC00 + (c & 0x3FF);
+                            if (node == 0) {
+                                break;
+                            }
+                        }
+                        node = child(node, static_cast<wchar_t>(c));
+                        if (node == 0) {
+                            break;
+                        }
+                        if (Table::nodes[node].ipa != 0) {
+                            ipa = Table::nodes[node].ipa;
+                            matchEnd = next;
+                        }
+                    }
+                    if (ipa != 0) {
+                        encodeUtf8(&ipa, 1, ipaWord);
+                        i = matchEnd;
+                    } else {
+                        const auto start = i;
+                        decodeUtf8Char(data, len, i);
+                        ipaWord.append(data + start, i - start);
+                    }
+                }
+            }
+
+        private:
+            // Entry for an IPA character, or nullptr if it has no romanization
+            static const StaticIpaEntry *lookup(const uint32_t c) {
+                if (c < Table::directSize) {
+                    const auto index = Table::direct[c];
+                    return index == NoStaticEntry ? nullptr : &Table::ipa[index];
+                }
+                size_t low = 0;
+                size_t high = Table::ipaCount;
+                while (low < high) {
+                    const auto mid = (low + high) / 2;
+                    const auto ipa = static_cast<uint32_t>(Table::ipa[mid].ipa);
+                    if (ipa == c) {
+                        return &Table::ipa[mid];
+                    }
+                    if (ipa < c) {
+                        low = mid + 1;
+                    } else {
+                        high = mid;
+                    }
+                }
+                return nullptr;
+            }
+
+            // Child of node for c, or 0 if there isn't one
+            static uint32_t child(const uint32_t node, const wchar_t c) {
+                auto low = Table::nodes[node].firstEdge;
+                auto high = low + Table::nodes[node].edgeCount;
+                while (low < high) {
+                    const auto mid = (low + high) / 2;
+                    if (Table::edges[mid].c == c) {
+                        return Table::edges[mid].child;
+                    }
+                    if (Table::edges[mid].c < c) {
+                        low = mid + 1;
+                    } else {
+                        high = mid;
+                    }
+                }
+                return 0;
+            }
+        };
+    }
+}
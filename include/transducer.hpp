@@ -0,0 +1,84 @@
+// Soundwarp cascades composed into a single finite-state transducer
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <err.hpp>
+#include <sndwrp.hpp>
+
+namespace natevolve {
+    namespace sndwrp {
+        // An ordered list of sound changes composed into one deterministic transducer,
+        // so evolving a word takes a single left-to-right pass however many changes there are.
+        //
+        // Each change only ever looks one sound ahead, so it can be run as a tiny machine that
+        // holds back a matching sound until it sees the next one. The composed state is the state
+        // of every one of those machines. States and transitions are discovered while applying
+        // and cached, and the cache is dropped and rebuilt when it grows past maxStates.
+        // Because of that apply is not const and a Transducer shouldn't be shared between threads.
+        // Results are identical to applyAllChanges, which remains the reference
+        struct Transducer {
+            // -------- Functions --------
+
+            Transducer(const std::vector<SoundChange> &changes, const size_t maxStates = 1 << 14);
+
+            // Same as applyAllChanges on the changes this was composed from
+            Result<std::wstring> apply(const std::wstring &word);
+
+            // Same as above, but write into a caller-owned buffer
+            std::optional<Error> apply(const std::wstring &word, std::wstring &out);
+
+            // How many states are currently cached
+            size_t stateCount(void) const;
+
+            // -------- Members --------
+
+            // Compiled changes used to discover new states
+            const Cascade cascade;
+
+            // Cached states are dropped after this many are built
+            const size_t maxStates;
+
+            // Cached transitions. Output ids live in outputs[outBegin, outEnd)
+            struct Edge {
+                uint32_t next;
+                uint32_t outBegin;
+                uint32_t outEnd;
+            };
+
+            // The per-change machine states making up each composed state, one byte per change
+            std::vector<std::string> stateKeys;
+            std::unordered_map<std::string, uint32_t> stateIds;
+
+            // Transition table, one row of inventory-size edges per state
+            std::vector<Edge> edges;
+
+            // What each state emits when the word ends, computed on first use
+            std::vector<Edge> finals;
+
+            // Pool of ids emitted by cached transitions
+            std::vector<uint16_t> outputs;
+
+            // Reusable buffers
+            std::vector<uint16_t> ids;
+            std::vector<uint16_t> changedIds;
+            std::vector<uint16_t> pending;
+            std::vector<uint16_t> produced;
+
+        private:
+            uint32_t intern(const std::string &key);
+            void reset(void);
+            void simulate(
+                std::string &key, const uint16_t *input, const size_t len, const bool end
+            );
+            uint32_t step(const uint32_t state, const uint16_t id);
+            void finish(const uint32_t state);
+
+            size_t generation;
+        };
+    }
+}
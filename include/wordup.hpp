@@ -5,29 +5,195 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <random>
+#include <utility>
+#include <cstdint>
 #include <optional>
+#include <functional>
+#include <string_view>
 #include <err.hpp>
+#include <pool.hpp>
+#include <philox.hpp>
 
 namespace natevolve {
     namespace wordup {
+        // A batch of generated words stored back to back in one string
+        struct WordArena {
+            // -------- Functions --------
+
+            // Number of words
+            size_t size(void) const;
+
+            // Word i, pointing into text
+            std::wstring_view word(const size_t i) const;
+
+            // -------- Members --------
+
+            // Word i is text[offsets[i], offsets[i + 1])
+            std::wstring text;
+            std::vector<size_t> offsets;
+        };
+
+        // How often a Generator picks each of its choices, relative to the others it's picked
+        // against. A list that's left empty (or is the wrong size) means every choice is as
+        // likely as the rest. Weights of 0 are never picked but still count in the word space
+        struct Weights {
+            // Weights of a category's sounds, in the same order as the category
+            std::map<std::wstring, std::vector<double>> sounds;
+
+            std::vector<double> vowels;
+            std::vector<double> onsets;
+            std::vector<double> codas;
+
+            // How many syllables a word has, paired with how likely that is.
+            // Empty means every word is one syllable
+            std::vector<std::pair<size_t, double>> syllables;
+        };
+
+        // Walker's alias method for picking from weighted choices. Every pick costs one random
+        // number and a comparison against a second one however the weights are spread out,
+        // and just the one random number when they're all equal
+        struct AliasTable {
+            // -------- Functions --------
+
+            AliasTable(const std::vector<double> &weights = {});
+
+            // Pick one of the choices with a random number generator giving 32-bit numbers
+            template <typename Rng>
+            uint32_t sample(Rng &rng) const {
+                if (entries.size() <= 1) {
+                    return 0;
+                }
+                const auto choice = static_cast<uint32_t>(
+                    (static_cast<uint64_t>(static_cast<uint32_t>(rng())) * entries.size()) >> 32
+                );
+                if (even) {
+                    return choice;
+                }
+                const auto &entry = entries[choice];
+                return static_cast<uint32_t>(rng()) < entry.threshold ? choice : entry.alias;
+            }
+
+            // -------- Members --------
+
+            // A choice stays itself if the second random number is under threshold, and becomes
+            // alias otherwise. Choices that always stay themselves are their own alias
+            struct Entry {
+                uint32_t threshold;
+                uint32_t alias;
+            };
+            std::vector<Entry> entries;
+
+            // Whether every choice is equally likely, so the first random number is enough
+            bool even;
+        };
+
         struct Generator {
             // -------- Functions --------
 
+            // Weights are written after a sound, vowel or option as ':2'. A ':' that isn't
+            // followed by a number stays part of the sound, so a: works as a long vowel.
+            // A fifth section can give how many syllables words have, one count per line,
+            // also with optional weights
             static Result<Generator> fromFile(const char *const fileName);
 
             Generator(
                 const std::map<std::wstring, std::vector<std::wstring>> &cats,
                 const std::vector<std::wstring> &vwls,
                 const std::vector<std::vector<std::wstring>> &onsets,
-                const std::vector<std::vector<std::wstring>> &codas
+                const std::vector<std::vector<std::wstring>> &codas,
+                const Weights &wts = Weights {}
             );
 
             // Given a set up Generator, create a word for me
             Result<std::wstring> generate(void) const;
 
+            // Same as above, but write into a caller-owned buffer
+            std::optional<Error> generate(std::wstring &out) const;
+
+            // Same as above, but draw from rng instead of the global generator.
+            // Rng can be any engine whose numbers cover at least 32 bits, like Philox or
+            // std::mt19937
+            template <typename Rng>
+            std::optional<Error> generate(Rng &rng, std::wstring &out) const {
+                out.clear();
+                out.reserve(maxLength);
+                return append(rng, out);
+            }
+
+            // Word k of the run with the given seed, worked out on its own.
+            // It's the same word generateInto gives at index k for that seed
+            std::optional<Error> generateAt(
+                const uint64_t seed, const uint64_t k, std::wstring &out
+            ) const;
+
+            // Generate count words on a Pool, overwriting out.
+            // Word k is drawn from its own Philox stream keyed by seed, so the same seed always
+            // gives the same words however many threads there are, and any one can be redone
+            // with generateAt.
+            // Without a seed, one is picked at random.
+            // If an undefined category gets picked, the first such error is returned
+            std::optional<Error> generateInto(
+                const size_t count, WordArena &out, Pool &pool,
+                const std::optional<uint64_t> seed = std::nullopt
+            ) const;
+
+            // Same as above, but give back a new arena
+            Result<WordArena> generateN(
+                const size_t count, Pool &pool, const std::optional<uint64_t> seed = std::nullopt
+            ) const;
+
+            // Number of ways to build a word. A syllable can be each onset, times each vowel,
+            // times each coda, and a word of n syllables can be any n of those in a row.
+            // Different ways can spell the same word, so there may be fewer distinct words.
+            // Saturates at UINT64_MAX
+            uint64_t spaceSize(void) const;
+
+            // Generate count different words on a Pool, overwriting out. Fails with OutOfRange
+            // if there can't be that many, and with UnknownCategory if any option uses one.
+            // Random words are drawn until enough new ones turn up. Once count is a large share
+            // of the space, or the draws keep turning up the same words, every way of building
+            // a word is listed and a weighted random selection of them taken instead, which
+            // picks words just as drawing them and throwing away repeats would. Listing only
+            // happens for spaces of up to 2^22 ways, which bounds its memory. Past that, ways
+            // are drawn evenly by index until there are enough, failing with OutOfRange if
+            // they still keep colliding. Those draws only follow the weights as far as never
+            // picking a way that uses something with a weight of 0
+            std::optional<Error> generateUniqueInto(
+                const size_t count, WordArena &out, Pool &pool
+            ) const;
+
+            // Same as above, but give back a new arena
+            Result<WordArena> generateUnique(const size_t count, Pool &pool) const;
+
+            // Every way of building a word has an index in [0, spaceSize()). Shorter words come
+            // first, and within a length indices count through the syllables with the first one
+            // changing slowest. A syllable counts through the onsets, then the vowels, then the
+            // codas, each in the order they're written in, with an option's first category
+            // changing slowest. Mapping between indices and words
+            // makes it easy to sample without repeats, resume listing words, or split the space
+            // between processes. Only exact while spaceSize() doesn't saturate
+
+            // Write the word with the given index into out. Fails with OutOfRange past the end
+            std::optional<Error> unrank(const uint64_t index, std::wstring &out) const;
+
+            // Same as above, but give back a new string
+            Result<std::wstring> unrank(const uint64_t index) const;
+
+            // The lowest index of word, or OutOfRange if the settings can't build it.
+            // Unlike unrank this is a search: the word can split into sounds many ways, so every
+            // option and every sound of its categories is tried in index order, backtracking on
+            // a mismatch. Positions found unable to finish a number of syllables are remembered,
+            // so for a word of n characters and at most k syllables it matches at most n * k
+            // syllables, each costing up to every way of building one that fits at that point
+            Result<uint64_t> rank(const std::wstring &word) const;
+
             // Store the generator settings in a file
             std::optional<Error> toFile(const char *const fileName) const;
 
+            // Every sound the generator can use, from its categories and vowels, each once
+            std::vector<std::wstring> inventory(void) const;
+
             // -------- Members --------
 
             // A mapping from a character to the list of symbols it represents.
@@ -42,7 +208,204 @@ namespace natevolve {
             
             // What are allowed codas? { C }, { C, C }, { C, L }, etc
             const std::vector<std::vector<std::wstring>> codaOptions;
+
+            // How likely each of the above is. Every list is filled in, and the syllable counts
+            // are sorted with no repeats
+            const Weights weights;
+
+            // -------- Compiled form --------
+            // Everything above resolved to indices by the constructor, so generate doesn't do
+            // any map lookups, copies or string streams
+
+            // Marks an onset or coda category that isn't defined
+            static constexpr uint32_t MissingCategory = UINT32_MAX;
+
+            // Every sound back to back. Sound i is soundPool[soundOffsets[i], soundOffsets[i + 1])
+            std::wstring soundPool;
+            std::vector<uint32_t> soundOffsets;
+
+            // Category c is sounds [categorySounds[c], categorySounds[c + 1]), picked from
+            // with categoryTables[c]. Categories are in the same order as the map,
+            // and the vowels come after them as one extra category
+            std::vector<uint32_t> categorySounds;
+            std::vector<AliasTable> categoryTables;
+            uint32_t vowelCategory;
+
+            // Onset option o is the categories
+            // onsetCategories[onsetOffsets[o], onsetOffsets[o + 1]), cut off at the first ∅.
+            // Codas are laid out the same way
+            std::vector<uint32_t> onsetCategories;
+            std::vector<uint32_t> onsetOffsets;
+            AliasTable onsetTable;
+            std::vector<uint32_t> codaCategories;
+            std::vector<uint32_t> codaOffsets;
+            AliasTable codaTable;
+
+            // Picks an index into weights.syllables
+            AliasTable syllableTable;
+
+            // Longest word generate can make, so out only has to be reserved once
+            size_t maxLength;
+
+            // Ways to build each option, as a number in mixed radix with one digit per category.
+            // Option o covers [starts[o], starts[o + 1]) and digit i has the weight strides[i]
+            std::vector<uint64_t> onsetStrides;
+            std::vector<uint64_t> onsetStarts;
+            std::vector<uint64_t> codaStrides;
+            std::vector<uint64_t> codaStarts;
+
+            // Ways to build one syllable
+            uint64_t syllableSpace;
+
+            // Words with weights.syllables[i] syllables have the indices
+            // [syllableStarts[i], syllableStarts[i + 1])
+            std::vector<uint64_t> syllableStarts;
+
+            // Ways to build a word, see spaceSize
+            uint64_t space;
+
+            // Chance of generate picking each pooled sound within its category, each option,
+            // and each entry of weights.syllables, the same as the alias tables give
+            std::vector<double> soundChances;
+            std::vector<double> onsetChances;
+            std::vector<double> codaChances;
+            std::vector<double> lengthChances;
+
+            // Add the word with the given index onto the end of out, without checking the index
+            void spell(const uint64_t index, std::wstring &out) const;
+
+        private:
+            // Add one random word onto the end of out
+            template <typename Rng>
+            std::optional<Error> append(Rng &rng, std::wstring &out) const;
+
+            // Chance of generate building a word the way with the given index
+            double wayChance(const uint64_t index) const;
+
+            // Same as above for one syllable
+            double syllableChance(const uint64_t index) const;
+
+            // Add the syllable with the given index onto the end of out
+            void spellSyllable(const uint64_t index, std::wstring &out) const;
+
+            // Try every way of building a syllable at word[pos...] in index order, calling
+            // rest(end, index) for each until it gives true
+            bool matchSyllable(
+                const std::wstring &word, const size_t pos,
+                const std::function<bool(size_t, uint64_t)> &rest
+            ) const;
+
+            // generateUniqueInto by drawing random words, or random indices if evenly is set.
+            // Gives back true if there were too many collisions, so something else has to be tried
+            bool sampleUnique(
+                const size_t count, WordArena &out, Pool &pool, const bool evenly
+            ) const;
+
+            // generateUniqueInto by listing every word
+            std::optional<Error> enumerateUnique(
+                const size_t count, WordArena &out, Pool &pool
+            ) const;
+
+            // Add a sound from every category of the option to out
+            template <typename Rng>
+            std::optional<Error> addOption(
+                Rng &rng,
+                const std::vector<uint32_t> &cats, const std::vector<uint32_t> &offsets,
+                const size_t option, const std::vector<std::vector<std::wstring>> &names,
+                std::wstring &out
+            ) const;
+        };
+
+        // Defined here rather than in wordup.cpp so generate(rng, out) works with any engine
+        template <typename Rng>
+        std::optional<Error> Generator::addOption(
+                Rng &rng,
+                const std::vector<uint32_t> &cats, const std::vector<uint32_t> &offsets,
+                const size_t option, const std::vector<std::vector<std::wstring>> &names,
+                std::wstring &out) const {
+            for (auto i = offsets[option]; i < offsets[option + 1]; i++) {
+                const auto cat = cats[i];
+                if (cat == MissingCategory) {
+                    return Error { ErrorType::UnknownCategory, names[option][i - offsets[option]] };
+                }
+                const auto sound = categorySounds[cat] + categoryTables[cat].sample(rng);
+                out.append(
+                    soundPool, soundOffsets[sound], soundOffsets[sound + 1] - soundOffsets[sound]
+                );
+            }
+            return std::nullopt;
+        }
+
+        template <typename Rng>
+        std::optional<Error> Generator::append(Rng &rng, std::wstring &out) const {
+            const auto syllables = weights.syllables[syllableTable.sample(rng)].first;
+            for (size_t syllable = 0; syllable < syllables; syllable++) {
+                // Generate a random onset
+                const auto onsetRes = addOption(
+                    rng, onsetCategories, onsetOffsets, onsetTable.sample(rng), onsetOptions, out
+                );
+                if (onsetRes.has_value()) {
+                    return onsetRes;
+                }
+
+                // Pick a random vowel
+                const auto vowel =
+                    categorySounds[vowelCategory] + categoryTables[vowelCategory].sample(rng);
+                out.append(
+                    soundPool, soundOffsets[vowel], soundOffsets[vowel + 1] - soundOffsets[vowel]
+                );
+
+                // Generate a random coda
+                const auto codaRes = addOption(
+                    rng, codaCategories, codaOffsets, codaTable.sample(rng), codaOptions, out
+                );
+                if (codaRes.has_value()) {
+                    return codaRes;
+                }
+            }
+            return std::nullopt;
+        }
+
+        // Walks through a generator's words lazily in index order, the same order as unrank.
+        // Moving on to the next word only counts up the sounds that change, so it's cheaper
+        // than unranking every index
+        struct WordIterator {
+            // -------- Functions --------
+
+            // Cover the indices [begin, end) of gen, which has to outlive this
+            WordIterator(
+                const Generator &gen, const uint64_t begin = 0, const uint64_t end = UINT64_MAX
+            );
+
+            // Write the next word into out. Gives false once there are no more
+            bool next(std::wstring &out);
+
+            // Index of the word next writes
+            uint64_t index(void) const;
+
+            // -------- Members --------
+
+            const Generator &gen;
+
+            // Where the walk is and where it stops
+            uint64_t position;
+            uint64_t last;
+
+            // Where in the onset or coda options the walk is.
+            // digits[i] is which sound of the option's category i is used
+            struct Part {
+                size_t option;
+                std::vector<uint32_t> digits;
+            };
+            struct Syllable {
+                Part onset;
+                size_t vowel;
+                Part coda;
+            };
+
+            // Which of gen.weights.syllables the current word's length is, and its syllables
+            size_t length;
+            std::vector<Syllable> syllables;
         };
     }
 }
-
@@ -0,0 +1,367 @@
+// Compiled form of Soundwarp changes
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <utility>
+#include <optional>
+#include <algorithm>
+#include <err.hpp>
+#include <natevolve.hpp>
+#include <pool.hpp>
+#include <simd.hpp>
+#include <sndwrp.hpp>
+
+using namespace natevolve;
+using namespace sndwrp;
+
+static inline bool testBit(
+        const std::vector<uint64_t> &bits, const size_t offset, const uint16_t id) {
+    return (bits[offset + (id >> 6)] >> (id & 63)) & 1;
+}
+
+static inline void setBit(
+        std::vector<uint64_t> &bits, const size_t offset, const uint16_t id) {
+    bits[offset + (id >> 6)] |= uint64_t(1) << (id & 63);
+}
+
+Inventory::Inventory(const std::vector<SoundChange> &changes): sounds({ L"" }), nodeIds({ 0 }) {
+    const auto add = [this](const std::wstring &sound) {
+        if (sound.empty() || idOf(sound) != 0) {
+            return;
+        }
+
+        // Walk down the trie, growing it where the sound hasn't been seen before
+        uint32_t node = 0;
+        for (const auto c : sound) {
+            const auto index = static_cast<size_t>(static_cast<uint32_t>(c));
+            const auto key = (static_cast<uint64_t>(node) << 32) | index;
+            uint32_t next = 0;
+            if (node == 0 && index < 0x10000) {
+                if (index >= table.size()) {
+                    table.resize(index + 1, 0);
+                }
+                next = table[index];
+            } else {
+                const auto found = edges.find(key);
+                next = found == edges.end() ? 0 : found->second;
+            }
+            if (next == 0) {
+                next = static_cast<uint32_t>(nodeIds.size());
+                nodeIds.push_back(0);
+                if (node == 0 && index < 0x10000) {
+                    table[index] = next;
+                } else {
+                    edges.insert({ key, next });
+                }
+            }
+            node = next;
+        }
+        nodeIds[node] = static_cast<uint16_t>(sounds.size());
+        sounds.push_back(sound);
+    };
+    for (const auto &change : changes) {
+        add(change.a);
+        add(change.b);
+        for (const auto &sound : change.frntCond) {
+            add(sound);
+        }
+        for (const auto &sound : change.endCond) {
+            add(sound);
+        }
+    }
+}
+
+uint16_t Inventory::idOf(const std::wstring &sound) const {
+    return idOf(sound.data(), sound.length());
+}
+
+uint16_t Inventory::idOf(const wchar_t *const str, const size_t len) const {
+    uint32_t node = 0;
+    for (size_t i = 0; i < len; i++) {
+        const auto index = static_cast<size_t>(static_cast<uint32_t>(str[i]));
+        if (node == 0 && index < table.size()) {
+            node = table[index];
+        } else {
+            const auto found = edges.find((static_cast<uint64_t>(node) << 32) | index);
+            node = found == edges.end() ? 0 : found->second;
+        }
+        if (node == 0) {
+            return 0;
+        }
+    }
+    return nodeIds[node];
+}
+
+void Inventory::tokenize(const std::wstring &word, std::vector<uint16_t> &ids) const {
+    ids.clear();
+    const auto len = word.length();
+    size_t pos = 0;
+    while (pos < len) {
+        const auto end = segmentEnd(word.data(), len, pos);
+        ids.push_back(idOf(word.data() + pos, end - pos));
+        pos = end;
+    }
+}
+
+void Inventory::detokenize(
+        const std::vector<uint16_t> &ids, const std::wstring &source, std::wstring &word) const {
+    word.clear();
+    size_t pos = 0;
+    for (const auto id : ids) {
+        const auto end = segmentEnd(source.data(), source.length(), pos);
+        if (id == 0) {
+            word.append(source, pos, end - pos);
+        } else {
+            word.append(sounds[id]);
+        }
+        pos = end;
+    }
+}
+
+Cascade::Cascade(const std::vector<SoundChange> &changes):
+        inventory(changes), setWords((inventory.sounds.size() + 63) / 64) {
+    this->changes.reserve(changes.size());
+    bits.reserve(changes.size() * setWords * 2);
+    for (const auto &change : changes) {
+        CompiledChange compiled {
+            inventory.idOf(change.a), inventory.idOf(change.b),
+            change.frntCond.empty(), change.endCond.empty(),
+            false, false,
+            bits.size(), bits.size() + setWords
+        };
+        bits.resize(bits.size() + setWords * 2, 0);
+
+        // '#' also stays in the bitset since it can show up literally inside a word
+        for (const auto &sound : change.frntCond) {
+            compiled.frntBoundary = compiled.frntBoundary || sound == L"#";
+            setBit(bits, compiled.frntBits, inventory.idOf(sound));
+        }
+        for (const auto &sound : change.endCond) {
+            compiled.endBoundary = compiled.endBoundary || sound == L"#";
+            setBit(bits, compiled.endBits, inventory.idOf(sound));
+        }
+        this->changes.push_back(compiled);
+    }
+}
+
+void Trace::clear(void) {
+    std::fill(fired.begin(), fired.end(), 0);
+    steps.clear();
+}
+
+bool Trace::hasFired(const size_t change) const {
+    return (change >> 6) < fired.size() && ((fired[change >> 6] >> (change & 63)) & 1);
+}
+
+size_t TraceArena::size(void) const {
+    return stepOffsets.empty() ? 0 : stepOffsets.size() - 1;
+}
+
+bool TraceArena::hasFired(const size_t word, const size_t change) const {
+    return (fired[word * setWords + (change >> 6)] >> (change & 63)) & 1;
+}
+
+const Trace::Step *TraceArena::stepsBegin(const size_t word) const {
+    return steps.data() + stepOffsets[word];
+}
+
+const Trace::Step *TraceArena::stepsEnd(const size_t word) const {
+    return steps.data() + stepOffsets[word + 1];
+}
+
+// Tracing is a template parameter so the untraced loop has no trace checks in it at all
+template<bool Traced>
+static void applyChanges(const Cascade &cascade, Workspace &workspace, Trace *const trace) {
+    auto &ids = workspace.ids;
+    auto &counts = workspace.counts;
+    const auto &bits = cascade.bits;
+    if (counts.size() < cascade.inventory.sounds.size()) {
+        counts.assign(cascade.inventory.sounds.size(), 0);
+    }
+    for (const auto id : ids) {
+        counts[id]++;
+    }
+
+    const auto len = ids.size();
+    for (size_t c = 0; c < cascade.changes.size(); c++) {
+        const auto &change = cascade.changes[c];
+
+        // Changes are indexed by their target, so one lookup tells if this one can fire at all,
+        // and the scan can stop once every copy of the target has been seen
+        auto remaining = counts[change.a];
+        if (remaining == 0) {
+            continue;
+        }
+
+        // Conditions look at the word as it was before this change. Only the previous match
+        // can already have been rewritten, and it was the target sound before that
+        size_t lastFired = SIZE_MAX;
+        auto i = simd::find(ids.data(), len, 0, change.a);
+        while (i < len) {
+            const bool frontCondFulfilled = change.frntAny || (
+                i == 0
+                    ? change.frntBoundary
+                    : testBit(bits, change.frntBits, i - 1 == lastFired ? change.a : ids[i - 1])
+            );
+            const bool endCondFulfilled = change.endAny
+                || (
+                    i + 1 == len
+                        ? change.endBoundary : testBit(bits, change.endBits, ids[i + 1])
+                );
+            if (frontCondFulfilled && endCondFulfilled) {
+                ids[i] = change.b;
+                counts[change.a]--;
+                counts[change.b]++;
+                lastFired = i;
+                if (Traced) {
+                    trace->fired[c >> 6] |= uint64_t(1) << (c & 63);
+                    trace->steps.push_back(
+                        Trace::Step { static_cast<uint32_t>(c), static_cast<uint32_t>(i) }
+                    );
+                }
+            }
+            if (--remaining == 0) {
+                break;
+            }
+            i = simd::find(ids.data(), len, i + 1, change.a);
+        }
+    }
+
+    // Only sounds still in the word can have a non-zero count
+    for (const auto id : ids) {
+        counts[id] = 0;
+    }
+}
+
+void Cascade::applyIds(Workspace &workspace, Trace *const trace) const {
+    if (trace == nullptr) {
+        applyChanges<false>(*this, workspace, nullptr);
+        return;
+    }
+    trace->fired.assign((changes.size() + 63) / 64, 0);
+    trace->steps.clear();
+    applyChanges<true>(*this, workspace, trace);
+}
+
+std::vector<std::pair<size_t, std::wstring>> Cascade::derivation(
+        const std::wstring &word,
+        const Trace::Step *const stepsBegin, const Trace::Step *const stepsEnd) const {
+    std::vector<std::pair<size_t, std::wstring>> forms;
+    std::vector<uint16_t> ids;
+    inventory.tokenize(word, ids);
+    for (auto step = stepsBegin; step != stepsEnd; step++) {
+        ids[step->position] = changes[step->change].b;
+
+        // Steps of one change are next to each other, so show the word once it's done with
+        if (step + 1 == stepsEnd || step[1].change != step->change) {
+            forms.emplace_back(step->change, std::wstring());
+            inventory.detokenize(ids, word, forms.back().second);
+        }
+    }
+    return forms;
+}
+
+Result<std::wstring> Cascade::apply(const std::wstring &word) const {
+    Workspace workspace;
+    std::wstring changedWord;
+    const auto error = apply(word, changedWord, workspace);
+    if (error.has_value()) {
+        return error.value();
+    }
+    return changedWord;
+}
+
+std::optional<Error> Cascade::apply(
+        const std::wstring &word, std::wstring &out, Workspace &workspace,
+        Trace *const trace) const {
+    inventory.tokenize(word, workspace.ids);
+    applyIds(workspace, trace);
+    inventory.detokenize(workspace.ids, word, out);
+    return std::nullopt;
+}
+
+Result<std::wstring> natevolve::sndwrp::applyAllChanges(
+        const std::wstring &word, const Cascade &cascade) {
+    return cascade.apply(word);
+}
+
+std::optional<Error> natevolve::sndwrp::applyAllChanges(
+        const std::wstring &word, const Cascade &cascade,
+        std::wstring &out, Workspace &workspace, Trace *const trace) {
+    return cascade.apply(word, out, workspace, trace);
+}
+
+// Words per task handed to the pool
+static constexpr size_t LexiconGrain = 256;
+
+std::vector<Result<std::wstring>> natevolve::sndwrp::applyToLexicon(
+        const std::wstring *const words, const size_t count,
+        const Cascade &cascade, Pool &pool) {
+    std::vector<Result<std::wstring>> results(count);
+    std::vector<Workspace> workspaces(pool.workers());
+    pool.parallelFor(count, LexiconGrain, [&](size_t begin, size_t end, size_t worker) {
+        auto &workspace = workspaces[worker];
+        for (size_t i = begin; i < end; i++) {
+            std::wstring changedWord;
+            const auto error = cascade.apply(words[i], changedWord, workspace);
+            if (error.has_value()) {
+                results[i] = error.value();
+            } else {
+                results[i] = std::move(changedWord);
+            }
+        }
+    });
+    return results;
+}
+
+std::vector<Result<std::wstring>> natevolve::sndwrp::applyToLexicon(
+        const std::wstring *const words, const size_t count,
+        const Cascade &cascade, Pool &pool, TraceArena &traces) {
+    traces.setWords = (cascade.changes.size() + 63) / 64;
+    traces.fired.assign(count * traces.setWords, 0);
+    traces.stepOffsets.assign(count + 1, 0);
+
+    // Each chunk collects its rewrites on its own and they're joined in order afterwards
+    std::vector<Result<std::wstring>> results(count);
+    std::vector<std::vector<Trace::Step>> chunkSteps((count + LexiconGrain - 1) / LexiconGrain);
+    std::vector<Workspace> workspaces(pool.workers());
+    std::vector<Trace> workerTraces(pool.workers());
+    pool.parallelFor(count, LexiconGrain, [&](size_t begin, size_t end, size_t worker) {
+        auto &workspace = workspaces[worker];
+        auto &trace = workerTraces[worker];
+        auto &steps = chunkSteps[begin / LexiconGrain];
+        for (size_t i = begin; i < end; i++) {
+            std::wstring changedWord;
+            const auto error = cascade.apply(words[i], changedWord, workspace, &trace);
+            if (error.has_value()) {
+                results[i] = error.value();
+            } else {
+                results[i] = std::move(changedWord);
+            }
+            std::copy(
+                trace.fired.begin(), trace.fired.end(),
+                traces.fired.begin() + i * traces.setWords
+            );
+            steps.insert(steps.end(), trace.steps.begin(), trace.steps.end());
+            traces.stepOffsets[i + 1] = trace.steps.size();
+        }
+    });
+
+    for (size_t i = 0; i < count; i++) {
+        traces.stepOffsets[i + 1] += traces.stepOffsets[i];
+    }
+    traces.steps.clear();
+    traces.steps.reserve(traces.stepOffsets[count]);
+    for (const auto &steps : chunkSteps) {
+        traces.steps.insert(traces.steps.end(), steps.begin(), steps.end());
+    }
+    return results;
+}
+
+std::vector<Result<std::wstring>> natevolve::sndwrp::applyToLexicon(
+        const std::vector<std::wstring> &words,
+        const std::vector<SoundChange> &changes, Pool &pool) {
+    const Cascade cascade(changes);
+    return applyToLexicon(words.data(), words.size(), cascade, pool);
+}
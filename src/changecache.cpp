@@ -0,0 +1,157 @@
+// Sharded CLOCK cache for Soundwarp results
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <err.hpp>
+#include <sndwrp.hpp>
+#include <changecache.hpp>
+
+using namespace natevolve;
+using namespace sndwrp;
+
+// FNV-1a
+static constexpr uint64_t FnvOffset = 14695981039346656037ull;
+static constexpr uint64_t FnvPrime = 1099511628211ull;
+
+static inline void hashValue(uint64_t &hash, const uint64_t value) {
+    hash = (hash ^ value) * FnvPrime;
+}
+
+static inline void hashSound(uint64_t &hash, const std::wstring &sound) {
+    for (const auto c : sound) {
+        hashValue(hash, static_cast<uint32_t>(c));
+    }
+    // Separator so { "ab" } and { "a", "b" } differ
+    hashValue(hash, UINT32_MAX);
+}
+
+uint64_t natevolve::sndwrp::fingerprint(const std::vector<SoundChange> &changes) {
+    auto hash = FnvOffset;
+    hashValue(hash, changes.size());
+    for (const auto &change : changes) {
+        hashSound(hash, change.a);
+        hashSound(hash, change.b);
+        hashValue(hash, change.frntCond.size());
+        for (const auto &sound : change.frntCond) {
+            hashSound(hash, sound);
+        }
+        hashValue(hash, change.endCond.size());
+        for (const auto &sound : change.endCond) {
+            hashSound(hash, sound);
+        }
+    }
+    return hash;
+}
+
+// Spread capacity evenly, rounding up so every shard holds at least one entry
+static size_t perShard(const size_t capacity, const size_t shards) {
+    return std::max<size_t>((capacity + shards - 1) / shards, 1);
+}
+
+ChangeCache::ChangeCache(const size_t capacity, const size_t shards):
+        shardCapacity(perShard(capacity, std::max<size_t>(shards, 1))),
+        shards(std::max<size_t>(shards, 1)), hits(0), misses(0), cascadeFingerprint(0) {
+    for (auto &shard : this->shards) {
+        shard.hand = 0;
+    }
+}
+
+size_t ChangeCache::hitCount(void) const {
+    return hits;
+}
+
+size_t ChangeCache::missCount(void) const {
+    return misses;
+}
+
+void ChangeCache::clear(void) {
+    for (auto &shard : shards) {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        shard.index.clear();
+        shard.entries.clear();
+        shard.hand = 0;
+    }
+}
+
+std::shared_ptr<const Cascade> ChangeCache::cascadeFor(
+        const std::vector<SoundChange> &changes, const uint64_t changesFingerprint) {
+    std::lock_guard<std::mutex> guard(cascadeLock);
+    if (cascade == nullptr || cascadeFingerprint != changesFingerprint) {
+        // The changes were edited, so nothing cached so far can be used again
+        cascade = std::make_shared<const Cascade>(changes);
+        cascadeFingerprint = changesFingerprint;
+        clear();
+    }
+    return cascade;
+}
+
+Result<std::wstring> ChangeCache::apply(
+        const std::wstring &word, const std::vector<SoundChange> &changes) {
+    return apply(word, changes, fingerprint(changes));
+}
+
+Result<std::wstring> ChangeCache::apply(
+        const std::wstring &word, const std::vector<SoundChange> &changes,
+        const uint64_t changesFingerprint) {
+    const auto hash = std::hash<std::wstring>()(word) ^ (changesFingerprint * FnvPrime);
+    auto &shard = shards[hash % shards.size()];
+    {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        const auto found = shard.index.find(word);
+        if (found != shard.index.end()) {
+            auto &entry = shard.entries[found->second];
+            if (entry.fingerprint == changesFingerprint) {
+                entry.referenced = true;
+                hits++;
+                return entry.result;
+            }
+        }
+    }
+    misses++;
+
+    // Work it out without holding the shard's lock
+    static thread_local Workspace workspace;
+    const auto compiled = cascadeFor(changes, changesFingerprint);
+    std::wstring changedWord;
+    const auto error = compiled->apply(word, changedWord, workspace);
+    Result<std::wstring> result = changedWord;
+    if (error.has_value()) {
+        result = error.value();
+    }
+
+    std::lock_guard<std::mutex> guard(shard.lock);
+    const auto found = shard.index.find(word);
+    if (found != shard.index.end()) {
+        // Either someone else got here first or the entry is from older changes
+        auto &entry = shard.entries[found->second];
+        entry.fingerprint = changesFingerprint;
+        entry.result = result;
+        entry.referenced = true;
+        return result;
+    }
+
+    if (shard.entries.size() < shardCapacity) {
+        shard.index.insert({ word, shard.entries.size() });
+        shard.entries.push_back(Entry { changesFingerprint, word, result, false });
+        return result;
+    }
+
+    // Sweep the clock hand, giving recently used entries a second chance
+    while (shard.entries[shard.hand].referenced) {
+        shard.entries[shard.hand].referenced = false;
+        shard.hand = (shard.hand + 1) % shard.entries.size();
+    }
+    auto &victim = shard.entries[shard.hand];
+    shard.index.erase(victim.word);
+    victim = Entry { changesFingerprint, word, result, false };
+    shard.index.insert({ word, shard.hand });
+    shard.hand = (shard.hand + 1) % shard.entries.size();
+    return result;
+}
@@ -0,0 +1,211 @@
+// Memory mapping for POSIX and Windows
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include <string>
+#include <cstddef>
+#include <optional>
+#include <err.hpp>
+#include <natevolve.hpp>
+#include <mapfile.hpp>
+
+using namespace natevolve;
+
+// Size of each read from a file that can't be mapped
+static constexpr size_t ReadChunk = 1 << 16;
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(void):
+    data(nullptr), size(0), mapped(false), file(nullptr), mapping(nullptr) {}
+
+std::optional<Error> MappedFile::open(const char *const fileName) {
+    close();
+    const auto handle = CreateFileA(
+        fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr
+    );
+    if (handle == INVALID_HANDLE_VALUE) {
+        return Error {
+            ErrorType::FileOpen,
+            toWstr("Failed to open '" + std::string(fileName) + "'")
+        };
+    }
+    file = handle;
+
+    // Pipes and consoles have no size to map, so read them to the end
+    if (GetFileType(handle) != FILE_TYPE_DISK) {
+        DWORD got = 0;
+        do {
+            const auto used = buffer.size();
+            buffer.resize(used + ReadChunk);
+            if (!ReadFile(handle, &buffer[used], ReadChunk, &got, nullptr)) {
+                got = 0;
+                if (GetLastError() != ERROR_BROKEN_PIPE) {
+                    close();
+                    return Error {
+                        ErrorType::FileRead,
+                        toWstr("Failed to read '" + std::string(fileName) + "'")
+                    };
+                }
+            }
+            buffer.resize(used + got);
+        } while (got > 0);
+        CloseHandle(handle);
+        file = nullptr;
+        data = buffer.empty() ? nullptr : buffer.data();
+        size = buffer.size();
+        return std::nullopt;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(handle, &fileSize)) {
+        close();
+        return Error {
+            ErrorType::FileRead,
+            toWstr("Failed to get the size of '" + std::string(fileName) + "'")
+        };
+    }
+    if (fileSize.QuadPart == 0) {
+        return std::nullopt;
+    }
+
+    mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    const auto view = mapping == nullptr
+        ? nullptr : MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == nullptr) {
+        close();
+        return Error {
+            ErrorType::FileRead,
+            toWstr("Failed to map '" + std::string(fileName) + "'")
+        };
+    }
+    data = static_cast<const char *>(view);
+    size = static_cast<size_t>(fileSize.QuadPart);
+    mapped = true;
+    return std::nullopt;
+}
+
+void MappedFile::close(void) {
+    if (mapped) {
+        UnmapViewOfFile(data);
+    }
+    if (mapping != nullptr) {
+        CloseHandle(mapping);
+    }
+    if (file != nullptr) {
+        CloseHandle(file);
+    }
+    data = nullptr;
+    size = 0;
+    mapped = false;
+    buffer = std::string();
+    mapping = nullptr;
+    file = nullptr;
+}
+
+// Pages of a read-only view are dropped by the OS on its own when memory gets tight
+void MappedFile::release(const size_t) {}
+
+#else
+
+MappedFile::MappedFile(void): data(nullptr), size(0), mapped(false) {}
+
+std::optional<Error> MappedFile::open(const char *const fileName) {
+    close();
+    const auto fd = ::open(fileName, O_RDONLY);
+    if (fd < 0) {
+        return Error {
+            ErrorType::FileOpen,
+            toWstr("Failed to open '" + std::string(fileName) + "'")
+        };
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        ::close(fd);
+        return Error {
+            ErrorType::FileRead,
+            toWstr("Failed to get the size of '" + std::string(fileName) + "'")
+        };
+    }
+
+    // Pipes, FIFOs and terminals have no size to map, so read them to the end
+    if (!S_ISREG(info.st_mode)) {
+        while (true) {
+            const auto used = buffer.size();
+            buffer.resize(used + ReadChunk);
+            const auto got = ::read(fd, &buffer[used], ReadChunk);
+            if (got < 0 && errno == EINTR) {
+                buffer.resize(used);
+                continue;
+            }
+            if (got < 0) {
+                ::close(fd);
+                close();
+                return Error {
+                    ErrorType::FileRead,
+                    toWstr("Failed to read '" + std::string(fileName) + "'")
+                };
+            }
+            buffer.resize(used + got);
+            if (got == 0) {
+                break;
+            }
+        }
+        ::close(fd);
+        data = buffer.empty() ? nullptr : buffer.data();
+        size = buffer.size();
+        return std::nullopt;
+    }
+    if (info.st_size == 0) {
+        ::close(fd);
+        return std::nullopt;
+    }
+
+    // The mapping keeps the file alive, so the descriptor isn't needed after this
+    const auto view = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED) {
+        return Error {
+            ErrorType::FileRead,
+            toWstr("Failed to map '" + std::string(fileName) + "'")
+        };
+    }
+    madvise(view, info.st_size, MADV_SEQUENTIAL);
+    data = static_cast<const char *>(view);
+    size = static_cast<size_t>(info.st_size);
+    mapped = true;
+    return std::nullopt;
+}
+
+void MappedFile::close(void) {
+    if (mapped) {
+        munmap(const_cast<char *>(data), size);
+    }
+    data = nullptr;
+    size = 0;
+    mapped = false;
+    buffer = std::string();
+}
+
+void MappedFile::release(const size_t end) {
+    const auto page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const auto pages = (end < size ? end : size) / page * page;
+    if (mapped && pages > 0) {
+        madvise(const_cast<char *>(data), pages, MADV_DONTNEED);
+    }
+}
+
+#endif
+
+MappedFile::~MappedFile(void) {
+    close();
+}
@@ -0,0 +1,234 @@
+// Implementation of the generate, evolve and romanize pipeline
+
+#include <chrono>
+#include <vector>
+#include <string>
+#include <utility>
+#include <optional>
+#include <algorithm>
+#include <functional>
+#include <err.hpp>
+#include <natevolve.hpp>
+#include <pool.hpp>
+#include <wordup.hpp>
+#include <sndwrp.hpp>
+#include <romanizer.hpp>
+#include <pipeline.hpp>
+
+using namespace natevolve;
+
+// Words in a chunk of a batch, which goes through one stage at a time so each can be timed
+static constexpr size_t PipelineChunk = 1024;
+
+bool Filter::rejects(const std::wstring &word) const {
+    if (minLength > 0 || maxLength < SIZE_MAX) {
+        size_t sounds = 0;
+        size_t pos = 0;
+        while (pos < word.length()) {
+            pos = segmentEnd(word.data(), word.length(), pos);
+            sounds++;
+        }
+        if (sounds < minLength || sounds > maxLength) {
+            return true;
+        }
+    }
+    for (const auto &part : blacklist) {
+        if (!part.empty() && word.find(part) != std::wstring::npos) {
+            return true;
+        }
+    }
+    return false;
+}
+
+double StageStats::wordsPerSecond(void) const {
+    return nanoseconds == 0 ? 0.0 : static_cast<double>(words) * 1e9 / nanoseconds;
+}
+
+// Add the time since start to stats, and restart the clock
+static void addTime(StageStats &stats, std::chrono::steady_clock::time_point &start) {
+    const auto now = std::chrono::steady_clock::now();
+    stats.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count();
+    start = now;
+}
+
+static void addStats(StageStats &total, const StageStats &part) {
+    total.words += part.words;
+    total.rejected += part.rejected;
+    total.nanoseconds += part.nanoseconds;
+}
+
+Pipeline::Pipeline(
+        const wordup::Generator &gen, const sndwrp::Cascade *const cascade,
+        const romanizer::Romanizer *const romanization, const std::optional<uint64_t> seed,
+        const size_t batchSize):
+            gen(gen), cascade(cascade), romanization(romanization),
+            seed(
+                seed.has_value() ? seed.value()
+                    : (static_cast<uint64_t>(g_rng()) << 32) | g_rng()
+            ),
+            batchSize(std::max<size_t>(batchSize, 1)), first(0) {}
+
+void Pipeline::runChunk(
+        const uint64_t begin, const uint64_t end, Part &part,
+        sndwrp::Workspace &workspace) const {
+    part.stats = Stats {};
+    part.error = std::nullopt;
+    const auto count = static_cast<size_t>(end - begin);
+    if (part.proto.size() < count) {
+        part.proto.resize(count);
+        part.evolved.resize(count);
+        part.romanized.resize(count);
+        part.indices.resize(count);
+    }
+
+    // Words that get through a stage are moved down over the ones that didn't.
+    // Swapping rather than copying keeps every string's storage around for the next batch
+    const auto keep = [&part](const size_t from, const size_t to) {
+        if (from != to) {
+            std::swap(part.proto[from], part.proto[to]);
+            std::swap(part.evolved[from], part.evolved[to]);
+            std::swap(part.romanized[from], part.romanized[to]);
+            part.indices[to] = part.indices[from];
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    size_t kept = 0;
+    for (auto k = begin; k < end; k++) {
+        auto res = gen.generateAt(seed, k, part.proto[kept]);
+        if (res.has_value()) {
+            part.error = std::move(res);
+            part.size = 0;
+            return;
+        }
+        if (!protoFilter.rejects(part.proto[kept])) {
+            part.indices[kept] = k;
+            kept++;
+        }
+    }
+    part.stats.generate = StageStats { count, count - kept, 0 };
+    addTime(part.stats.generate, start);
+
+    const auto generated = kept;
+    kept = 0;
+    for (size_t j = 0; j < generated; j++) {
+        if (cascade != nullptr) {
+            auto res = cascade->apply(part.proto[j], part.evolved[j], workspace);
+            if (res.has_value()) {
+                part.error = std::move(res);
+                part.size = 0;
+                return;
+            }
+        } else {
+            part.evolved[j] = part.proto[j];
+        }
+        if (!evolvedFilter.rejects(part.evolved[j])) {
+            keep(j, kept++);
+        }
+    }
+    part.stats.evolve = StageStats { generated, generated - kept, 0 };
+    addTime(part.stats.evolve, start);
+
+    const auto evolved = kept;
+    kept = 0;
+    for (size_t j = 0; j < evolved; j++) {
+        if (romanization != nullptr) {
+            romanization->romanize(part.evolved[j], part.romanized[j]);
+        } else {
+            part.romanized[j] = part.evolved[j];
+        }
+        if (!romanizedFilter.rejects(part.romanized[j])) {
+            keep(j, kept++);
+        }
+    }
+    part.stats.romanize = StageStats { evolved, evolved - kept, 0 };
+    addTime(part.stats.romanize, start);
+    part.size = kept;
+}
+
+bool Pipeline::isHomophone(const Part &part, const size_t j) {
+    const std::hash<std::wstring> hash;
+    const auto protoHash = hash(part.proto[j]);
+    const auto evolvedHash = hash(part.evolved[j]);
+    const auto romanizedHash = hash(part.romanized[j]);
+    if (protoFilter.homophones && seenProto.count(protoHash) > 0) {
+        stats.generate.rejected++;
+        return true;
+    }
+    if (evolvedFilter.homophones && seenEvolved.count(evolvedHash) > 0) {
+        stats.evolve.rejected++;
+        return true;
+    }
+    if (romanizedFilter.homophones && seenRomanized.count(romanizedHash) > 0) {
+        stats.romanize.rejected++;
+        return true;
+    }
+    if (protoFilter.homophones) {
+        seenProto.insert(protoHash);
+    }
+    if (evolvedFilter.homophones) {
+        seenEvolved.insert(evolvedHash);
+    }
+    if (romanizedFilter.homophones) {
+        seenRomanized.insert(romanizedHash);
+    }
+    return false;
+}
+
+// Add a word onto the end of an arena
+static void appendWord(wordup::WordArena &arena, const std::wstring &word) {
+    arena.text += word;
+    arena.offsets.push_back(arena.text.length());
+}
+
+std::optional<Error> Pipeline::next(PipelineBatch &out, Pool &pool) {
+    const auto chunks = (batchSize + PipelineChunk - 1) / PipelineChunk;
+    if (parts.size() < chunks) {
+        parts.resize(chunks);
+    }
+    if (workspaces.size() < pool.workers()) {
+        workspaces.resize(pool.workers());
+    }
+    const auto batchFirst = first;
+    pool.parallelFor(batchSize, PipelineChunk, [&](
+            const size_t begin, const size_t end, const size_t worker) {
+        runChunk(
+            batchFirst + begin, batchFirst + end, parts[begin / PipelineChunk],
+            workspaces[worker]
+        );
+    });
+    first += batchSize;
+    for (size_t chunk = 0; chunk < chunks; chunk++) {
+        if (parts[chunk].error.has_value()) {
+            return parts[chunk].error;
+        }
+    }
+
+    // Check for homophones in word order, so which of two gets through doesn't depend on timing
+    auto start = std::chrono::steady_clock::now();
+    for (auto arena : { &out.proto, &out.evolved, &out.romanized }) {
+        arena->text.clear();
+        arena->offsets.assign(1, 0);
+    }
+    out.indices.clear();
+    size_t survivors = 0;
+    for (size_t chunk = 0; chunk < chunks; chunk++) {
+        const auto &part = parts[chunk];
+        addStats(stats.generate, part.stats.generate);
+        addStats(stats.evolve, part.stats.evolve);
+        addStats(stats.romanize, part.stats.romanize);
+        survivors += part.size;
+        for (size_t j = 0; j < part.size; j++) {
+            if (isHomophone(part, j)) {
+                continue;
+            }
+            appendWord(out.proto, part.proto[j]);
+            appendWord(out.evolved, part.evolved[j]);
+            appendWord(out.romanized, part.romanized[j]);
+            out.indices.push_back(part.indices[j]);
+        }
+    }
+    stats.collect.words += survivors;
+    addTime(stats.collect, start);
+    return std::nullopt;
+}
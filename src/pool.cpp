@@ -0,0 +1,132 @@
+// Implementation of the work-stealing thread pool
+
+#include <mutex>
+#include <algorithm>
+#include <deque>
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+#include <pool.hpp>
+
+using namespace natevolve;
+
+// Which worker of which pool the current thread is, so nested parallelFor calls on the same
+// pool reuse the right index. Any other pool sees the thread as an outside caller
+static thread_local const Pool *g_workerPool = nullptr;
+static thread_local size_t g_workerIndex = SIZE_MAX;
+
+Pool::Pool(const size_t threads): queues(
+            (threads == 0 ? std::max<size_t>(std::thread::hardware_concurrency(), 1) : threads) + 1
+        ), queued(0), stopping(false) {
+    // The last queue belongs to whoever calls parallelFor
+    for (size_t i = 0; i + 1 < queues.size(); i++) {
+        this->threads.emplace_back([this, i]() { work(i); });
+    }
+}
+
+Pool::~Pool(void) {
+    {
+        std::lock_guard<std::mutex> guard(sleepLock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+size_t Pool::workers(void) const {
+    return queues.size();
+}
+
+// Pop from our own queue first, otherwise steal from someone else's
+bool Pool::take(const size_t worker, Task &task) {
+    {
+        auto &own = queues[worker];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (!own.tasks.empty()) {
+            task = own.tasks.back();
+            own.tasks.pop_back();
+            queued--;
+            return true;
+        }
+    }
+    for (size_t i = 1; i < queues.size(); i++) {
+        auto &other = queues[(worker + i) % queues.size()];
+        std::lock_guard<std::mutex> guard(other.lock);
+        if (!other.tasks.empty()) {
+            task = other.tasks.front();
+            other.tasks.pop_front();
+            queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void Pool::run(const Task &task, const size_t worker) {
+    (*task.job->task)(task.begin, task.end, worker);
+    if (--task.job->remaining == 0) {
+        std::lock_guard<std::mutex> guard(doneLock);
+        done.notify_all();
+    }
+}
+
+void Pool::work(const size_t worker) {
+    g_workerPool = this;
+    g_workerIndex = worker;
+    while (true) {
+        Task task;
+        if (take(worker, task)) {
+            run(task, worker);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> guard(sleepLock);
+        wake.wait(guard, [this]() { return stopping || queued > 0; });
+        if (stopping && queued == 0) {
+            return;
+        }
+    }
+}
+
+void Pool::parallelFor(
+        const size_t count, const size_t grain,
+        const std::function<void(size_t, size_t, size_t)> &task) {
+    if (count == 0) {
+        return;
+    }
+    const auto step = grain == 0 ? 1 : grain;
+    const auto chunks = (count + step - 1) / step;
+    const auto worker = g_workerPool == this ? g_workerIndex : queues.size() - 1;
+
+    Job job;
+    job.task = &task;
+    job.remaining = chunks;
+
+    // Deal the chunks out round-robin so every worker starts with its own share
+    for (size_t chunk = 0; chunk < chunks; chunk++) {
+        const auto begin = chunk * step;
+        const auto end = std::min(count, begin + step);
+        auto &queue = queues[chunk % queues.size()];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.tasks.push_back(Task { &job, begin, end });
+        queued++;
+    }
+    {
+        std::lock_guard<std::mutex> guard(sleepLock);
+    }
+    wake.notify_all();
+
+    while (job.remaining > 0) {
+        Task next;
+        if (take(worker, next)) {
+            run(next, worker);
+            continue;
+        }
+        std::unique_lock<std::mutex> guard(doneLock);
+        done.wait(guard, [&job]() { return job.remaining == 0; });
+    }
+}
@@ -0,0 +1,229 @@
+// Inverse Soundwarp cascades
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_set>
+#include <natevolve.hpp>
+#include <sndwrp.hpp>
+#include <reconstruct.hpp>
+
+using namespace natevolve;
+using namespace sndwrp;
+
+static inline bool testBit(const std::vector<uint64_t> &bits, const uint16_t id) {
+    return (bits[id >> 6] >> (id & 63)) & 1;
+}
+
+static inline void setBit(std::vector<uint64_t> &bits, const uint16_t id) {
+    bits[id >> 6] |= uint64_t(1) << (id & 63);
+}
+
+// A change that can't alter a word, either because it maps a sound to itself or
+// because its target is empty (see SoundChange::apply)
+static inline bool isNoOp(const CompiledChange &change) {
+    return change.a == 0 || change.a == change.b;
+}
+
+Reconstructor::Reconstructor(
+        const std::vector<SoundChange> &changes, const std::vector<std::wstring> &protoSounds):
+            cascade(changes), constrained(!protoSounds.empty()), depth(0), pendingWord(false) {
+    // Every undone change pushes one frame, so they never move once made
+    frames.reserve(changes.size() + 1);
+    touching.resize(cascade.inventory.sounds.size());
+    for (size_t i = 0; i < cascade.changes.size(); i++) {
+        const auto &change = cascade.changes[i];
+        if (!isNoOp(change)) {
+            touching[change.a].push_back(static_cast<uint32_t>(i));
+            touching[change.b].push_back(static_cast<uint32_t>(i));
+        }
+    }
+    if (!constrained) {
+        return;
+    }
+
+    const auto setWords = (cascade.inventory.sounds.size() + 63) / 64;
+    reachable.assign(cascade.changes.size() + 1, std::vector<uint64_t>(setWords, 0));
+    for (const auto &sound : protoSounds) {
+        size_t pos = 0;
+        while (pos < sound.length()) {
+            const auto end = segmentEnd(sound.data(), sound.length(), pos);
+            const auto id = cascade.inventory.idOf(sound.data() + pos, end - pos);
+            if (id == 0) {
+                otherSounds.insert(sound.substr(pos, end - pos));
+            } else {
+                setBit(reachable[0], id);
+            }
+            pos = end;
+        }
+    }
+
+    // A change adds its result to what's reachable once its target is
+    for (size_t i = 0; i < cascade.changes.size(); i++) {
+        const auto &change = cascade.changes[i];
+        reachable[i + 1] = reachable[i];
+        if (!isNoOp(change) && testBit(reachable[i], change.a)) {
+            setBit(reachable[i + 1], change.b);
+        }
+    }
+}
+
+bool Reconstructor::allowed(const size_t change, const uint16_t id) const {
+    return !constrained || id == 0 || testBit(reachable[change], id);
+}
+
+// Whether applying the frame's change to the candidate really gives the target at pos.
+// Both neighbors of pos must already be chosen
+bool Reconstructor::consistent(const Frame &frame, const size_t pos) const {
+    const auto &change = cascade.changes[frame.change];
+    const auto &ids = frame.ids;
+    if (ids[pos] != change.a) {
+        return true;
+    }
+    const auto len = ids.size();
+    const auto &bits = cascade.bits;
+    const auto frntId = pos == 0 ? 0 : ids[pos - 1];
+    const auto endId = pos + 1 == len ? 0 : ids[pos + 1];
+    const bool fires = (
+        change.frntAny || (
+            pos == 0
+                ? change.frntBoundary
+                : (bits[change.frntBits + (frntId >> 6)] >> (frntId & 63)) & 1
+        )
+    ) && (
+        change.endAny || (
+            pos + 1 == len
+                ? change.endBoundary
+                : (bits[change.endBits + (endId >> 6)] >> (endId & 63)) & 1
+        )
+    );
+    return fires == (frame.target[pos] == change.b);
+}
+
+// Find the next candidate for the word before the frame's change, backtracking from the last.
+// Each position is either the sound already there or, where the change's result is, its target
+bool Reconstructor::advance(Frame &frame) {
+    const auto &change = cascade.changes[frame.change];
+    const auto len = frame.target.size();
+    auto pos = frame.pos == len ? len - 1 : frame.pos;
+    while (true) {
+        if (frame.options[pos] == 2) {
+            frame.options[pos] = 0;
+            if (pos == 0) {
+                return false;
+            }
+            pos--;
+            continue;
+        }
+
+        const auto option = frame.options[pos]++;
+        if (option == 1 && frame.target[pos] != change.b) {
+            continue;
+        }
+        const auto id = option == 0 ? frame.target[pos] : change.a;
+        if (!allowed(frame.change, id)) {
+            continue;
+        }
+        frame.ids[pos] = id;
+        if (pos > 0 && !consistent(frame, pos - 1)) {
+            continue;
+        }
+        if (pos + 1 == len) {
+            if (!consistent(frame, pos)) {
+                continue;
+            }
+            frame.pos = len;
+            return true;
+        }
+        pos++;
+    }
+}
+
+// Index of the latest change before change that could have touched ids, or SIZE_MAX.
+// Changes whose target and result are both missing from the word are passed straight over
+size_t Reconstructor::skipUntouched(size_t change, const std::vector<uint16_t> &ids) const {
+    size_t latest = SIZE_MAX;
+    for (const auto id : ids) {
+        const auto &list = touching[id];
+        const auto found = std::lower_bound(list.begin(), list.end(), change);
+        if (found != list.begin() && (latest == SIZE_MAX || *(found - 1) > latest)) {
+            latest = *(found - 1);
+        }
+    }
+    return latest;
+}
+
+void Reconstructor::push(const size_t change, const std::vector<uint16_t> &target) {
+    if (depth == frames.size()) {
+        frames.emplace_back();
+    }
+    auto &frame = frames[depth++];
+    frame.change = change;
+    frame.target.assign(target.begin(), target.end());
+    frame.ids.assign(target.size(), 0);
+    frame.options.assign(target.size(), 0);
+    frame.pos = 0;
+}
+
+void Reconstructor::start(const std::wstring &word) {
+    this->word = word;
+    cascade.inventory.tokenize(word, wordIds);
+    depth = 0;
+    pendingWord = false;
+
+    // Sounds the changes never mention come through unchanged, so they must be proto sounds
+    if (constrained) {
+        size_t pos = 0;
+        for (const auto id : wordIds) {
+            const auto end = segmentEnd(word.data(), word.length(), pos);
+            if (id == 0 && otherSounds.count(word.substr(pos, end - pos)) == 0) {
+                return;
+            }
+            pos = end;
+        }
+    }
+
+    const auto change = skipUntouched(cascade.changes.size(), wordIds);
+    if (change == SIZE_MAX) {
+        pendingWord = true;
+        for (const auto id : wordIds) {
+            pendingWord = pendingWord && allowed(0, id);
+        }
+        return;
+    }
+    push(change, wordIds);
+}
+
+bool Reconstructor::next(std::wstring &out) {
+    if (pendingWord) {
+        pendingWord = false;
+        out = word;
+        return true;
+    }
+
+    while (depth > 0) {
+        auto &frame = frames[depth - 1];
+        if (!advance(frame)) {
+            depth--;
+            continue;
+        }
+
+        const auto change = skipUntouched(frame.change, frame.ids);
+        if (change != SIZE_MAX) {
+            push(change, frame.ids);
+            continue;
+        }
+
+        // Every change is undone, so this is an ancestor if it only uses proto sounds
+        bool proto = true;
+        for (const auto id : frame.ids) {
+            proto = proto && allowed(0, id);
+        }
+        if (proto) {
+            cascade.inventory.detokenize(frame.ids, word, out);
+            return true;
+        }
+    }
+    return false;
+}
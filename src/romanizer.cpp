@@ -1,45 +1,56 @@
 // Implementation of Romanizer funcitonality
 
 #include <map>
+#include <algorithm>
 #include <string>
-#include <fstream>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
 #include <sstream>
 #include <utility>
-#include <codecvt>
-#include <iostream>
 #include <err.hpp>
 #include <natevolve.hpp>
+#include <mapfile.hpp>
+#include <pool.hpp>
+#include <simd.hpp>
 #include <romanizer.hpp>
 
 using namespace natevolve;
 using namespace romanizer;
 
 Result<Romanizer> Romanizer::fromFile(const char *const fileName) {
-    std::wifstream file(fileName);
-#ifdef _WIN32
-    std::locale loc(std::locale::classic(), new std::codecvt_utf8<wchar_t>);
-    file.imbue(loc);
-#endif
-    if (!file.is_open()) {
-        return Error {
-            ErrorType::FileOpen,
-            toWstr("Failed to open '" + std::string(fileName) + "'")
-        };
+    // Decoded by hand so loading doesn't depend on the global locale
+    MappedFile file;
+    const auto openError = file.open(fileName);
+    if (openError.has_value()) {
+        return openError.value();
     }
+    std::wstring text;
+    decodeUtf8(file.data, file.size, text);
+    file.close();
 
     std::map<wchar_t, std::wstring> ipaToRom;
     std::map<std::wstring, wchar_t> romToIpa;
     size_t ln = 1;
     size_t col = 1;
     std::wstring line;
-    while (std::getline(file, line)) {
+    size_t pos = !text.empty() && text[0] == 0xFEFF ? 1 : 0;
+    while (pos < text.length()) {
+        auto end = text.find(L'\n', pos);
+        if (end == std::wstring::npos) {
+            end = text.length();
+        }
+        line.assign(text, pos, end - pos);
+        if (!line.empty() && line.back() == L'\r') {
+            line.pop_back();
+        }
+        pos = end + 1;
         if (line.empty()) {
             ln++;
             continue;
         }
 
-        std::wcout << line << std::endl;
-
         col = 1;
         while (col - 1 < line.length() && (line[col - 1] == ' ' || line[col - 1] == '\t')) {
             col++;
@@ -60,7 +71,6 @@ Result<Romanizer> Romanizer::fromFile(const char *const fileName) {
         while (col - 1 < line.length() && (line[col - 1] == ' ' || line[col - 1] == '\t')) {
             col++;
         }
-        std::wcout << a << std::endl;
 
         // Get the romanization character(s)
         if (col - 1 >= line.length()) {
@@ -96,56 +106,321 @@ Result<Romanizer> Romanizer::fromFile(const char *const fileName) {
         ln++;
     }
 
-    if (file.bad()) {
-        return Error {
-            ErrorType::FileRead,
-            toWstr(
-                "Failed to read '" + std::string(fileName)
-                    + "' at line " + std::to_string(ln) + ", col " + std::to_string(col)
-            )
-        };
-    }
-
-    file.close();
     return Romanizer(ipaToRom, romToIpa);
 }
 
 Romanizer::Romanizer(
     const std::map<wchar_t, std::wstring> &ipaToRom,
     const std::map<std::wstring, wchar_t> &romToIpa):
-        ipaToRomanization(ipaToRom), romanizationToIpa(romToIpa) {}
+        ipaToRomanization(ipaToRom), romanizationToIpa(romToIpa), romNodeIpa({ 0 }) {
+    asciiMapped[0] = asciiMapped[1] = 0;
+    asciiRomStart[0] = asciiRomStart[1] = 0;
+    for (const auto &ipaMap : ipaToRomanization) {
+        Span span {
+            static_cast<uint32_t>(romPool.length()),
+            static_cast<uint32_t>(romPool.length() + ipaMap.second.length()),
+            static_cast<uint32_t>(romPoolUtf8.length()), 0
+        };
+        romPool.append(ipaMap.second);
+        encodeUtf8(ipaMap.second.data(), ipaMap.second.length(), romPoolUtf8);
+        span.utf8End = static_cast<uint32_t>(romPoolUtf8.length());
+
+        const auto index = static_cast<size_t>(static_cast<uint32_t>(ipaMap.first));
+        if (index < 0x80) {
+            asciiMapped[index >> 6] |= uint64_t(1) << (index & 63);
+        }
+        if (index < 0x10000) {
+            if (index >= ipaTable.size()) {
+                ipaTable.resize(index + 1, Span { UnmappedSpan, UnmappedSpan, 0, 0 });
+            }
+            ipaTable[index] = span;
+        } else {
+            ipaOther.insert({ ipaMap.first, span });
+        }
+    }
+
+    for (const auto &romMap : romanizationToIpa) {
+        if (!romMap.first.empty() && static_cast<uint32_t>(romMap.first[0]) < 0x80) {
+            const auto first = static_cast<uint32_t>(romMap.first[0]);
+            asciiRomStart[first >> 6] |= uint64_t(1) << (first & 63);
+        }
+        uint32_t node = 0;
+        for (const auto c : romMap.first) {
+            auto next = romChild(node, c);
+            if (next == 0) {
+                next = static_cast<uint32_t>(romNodeIpa.size());
+                romNodeIpa.push_back(0);
+                const auto index = static_cast<size_t>(static_cast<uint32_t>(c));
+                if (node == 0 && index < 0x10000) {
+                    if (index >= romTable.size()) {
+                        romTable.resize(index + 1, 0);
+                    }
+                    romTable[index] = next;
+                } else {
+                    romEdges.insert({ (static_cast<uint64_t>(node) << 32) | index, next });
+                }
+            }
+            node = next;
+        }
+        romNodeIpa[node] = romMap.second;
+    }
+}
+
+uint32_t Romanizer::romChild(const uint32_t node, const wchar_t c) const {
+    const auto index = static_cast<size_t>(static_cast<uint32_t>(c));
+    if (node == 0 && index < 0x10000) {
+        return index < romTable.size() ? romTable[index] : 0;
+    }
+    const auto found = romEdges.find((static_cast<uint64_t>(node) << 32) | index);
+    return found == romEdges.end() ? 0 : found->second;
+}
+
+uint32_t Romanizer::romChild(uint32_t node, const uint32_t codePoint) const {
+    if (sizeof(wchar_t) == 2 && codePoint >= 0x10000) {
+        node = romChild(node, static_cast<wchar_t>(0xD800 + ((codePoint - 0x10000) >> 10)));
+        if (node == 0) {
+            return 0;
+        }
+        return romChild(node, static_cast<wchar_t>(0xDC00 + ((codePoint - 0x10000) & 0x3FF)));
+    }
+    return romChild(node, static_cast<wchar_t>(codePoint));
+}
+
+const Romanizer::Span *Romanizer::ipaSpan(const uint32_t codePoint) const {
+    if (codePoint < ipaTable.size()) {
+        return ipaTable[codePoint].begin == UnmappedSpan ? nullptr : &ipaTable[codePoint];
+    }
+    if (codePoint < 0x10000 || ipaOther.empty()) {
+        return nullptr;
+    }
+    const auto found = ipaOther.find(static_cast<wchar_t>(codePoint));
+    return found == ipaOther.end() ? nullptr : &found->second;
+}
 
 std::wstring Romanizer::romanize(const std::wstring &ipaWord) const {
-    std::wstringstream romWord;
+    std::wstring romWord;
+    romanize(ipaWord, romWord);
+    return romWord;
+}
+
+void Romanizer::romanize(const std::wstring &ipaWord, std::wstring &romWord) const {
+    romWord.clear();
+    romWord.reserve(ipaWord.length());
     for (const auto c : ipaWord) {
-        try {
-            romWord << ipaToRomanization.at(c);
-        } catch (std::out_of_range &) {
-            romWord << c;
+        const auto index = static_cast<size_t>(static_cast<uint32_t>(c));
+        auto span = Span { UnmappedSpan, UnmappedSpan };
+        if (index < ipaTable.size()) {
+            span = ipaTable[index];
+        } else if (index >= 0x10000 && !ipaOther.empty()) {
+            const auto found = ipaOther.find(c);
+            if (found != ipaOther.end()) {
+                span = found->second;
+            }
+        }
+
+        if (span.begin == UnmappedSpan) {
+            romWord.push_back(c);
+        } else {
+            romWord.append(romPool, span.begin, span.end - span.begin);
         }
     }
-    return romWord.str();
 }
 
 std::wstring Romanizer::unromanize(const std::wstring &romWord) const {
-    std::wstringstream ipaWord;
-    for (size_t i = 0; i < romWord.length(); i++) {
-        bool matched = false;
-        for (const auto &romMap : romanizationToIpa) {
-            if (romWord.substr(i).length() < romMap.first.length()) {
-                continue;
+    std::wstring ipaWord;
+    ipaWord.reserve(romWord.length());
+    const auto len = romWord.length();
+    size_t i = 0;
+    while (i < len) {
+        // Walk the trie as far as the word goes, remembering the longest full match on the way
+        uint32_t node = 0;
+        wchar_t ipa = 0;
+        size_t matchEnd = i;
+        for (size_t j = i; j < len; j++) {
+            node = romChild(node, romWord[j]);
+            if (node == 0) {
+                break;
+            }
+            if (romNodeIpa[node] != 0) {
+                ipa = romNodeIpa[node];
+                matchEnd = j + 1;
             }
-            if (romWord.substr(i, romMap.first.length()) == romMap.first) {
-                ipaWord << romMap.second;
-                i += romMap.first.length() - 1;
-                matched = true;
+        }
+        if (ipa != 0) {
+            ipaWord.push_back(ipa);
+            i = matchEnd;
+        } else {
+            ipaWord.push_back(romWord[i]);
+            i++;
+        }
+    }
+    return ipaWord;
+}
+
+static inline bool testAscii(const uint64_t bits[2], const unsigned char c) {
+    return (bits[c >> 6] >> (c & 63)) & 1;
+}
+
+void Romanizer::romanize(const std::string_view ipaWord, std::string &romWord) const {
+    const auto data = ipaWord.data();
+    const auto len = ipaWord.length();
+    const bool anyAsciiMapped = asciiMapped[0] != 0 || asciiMapped[1] != 0;
+    romWord.reserve(romWord.length() + len);
+    size_t i = 0;
+    while (i < len) {
+        // Copy the ASCII up to the next character that needs looking at
+        const auto run = simd::findNonAscii(data, len, i);
+        if (!anyAsciiMapped) {
+            romWord.append(data + i, run - i);
+            i = run;
+        }
+        while (i < run) {
+            auto end = i;
+            while (end < run && !testAscii(asciiMapped, static_cast<unsigned char>(data[end]))) {
+                end++;
+            }
+            romWord.append(data + i, end - i);
+            i = end;
+            if (i < run) {
+                const auto &span = ipaTable[static_cast<unsigned char>(data[i])];
+                romWord.append(romPoolUtf8, span.utf8Begin, span.utf8End - span.utf8Begin);
+                i++;
+            }
+        }
+        if (i == len) {
+            break;
+        }
+
+        const auto start = i;
+        const auto span = ipaSpan(decodeUtf8Char(data, len, i));
+        if (span == nullptr) {
+            romWord.append(data + start, i - start);
+        } else {
+            romWord.append(romPoolUtf8, span->utf8Begin, span->utf8End - span->utf8Begin);
+        }
+    }
+}
+
+void Romanizer::unromanize(const std::string_view romWord, std::string &ipaWord) const {
+    const auto data = romWord.data();
+    const auto len = romWord.length();
+    ipaWord.reserve(ipaWord.length() + len);
+    size_t i = 0;
+    while (i < len) {
+        // ASCII that can't start a romanization is copied in bulk
+        const auto run = simd::findNonAscii(data, len, i);
+        auto end = i;
+        while (end < run && !testAscii(asciiRomStart, static_cast<unsigned char>(data[end]))) {
+            end++;
+        }
+        ipaWord.append(data + i, end - i);
+        i = end;
+        if (i == len) {
+            break;
+        }
+
+        // Walk the trie as far as the word goes, remembering the longest full match on the way
+        uint32_t node = 0;
+        wchar_t ipa = 0;
+        size_t matchEnd = i;
+        auto next = i;
+        while (next < len) {
+            node = romChild(node, decodeUtf8Char(data, len, next));
+            if (node == 0) {
                 break;
             }
+            if (romNodeIpa[node] != 0) {
+                ipa = romNodeIpa[node];
+                matchEnd = next;
+            }
         }
-        if (!matched) {
-            ipaWord << romWord[i];
+        if (ipa != 0) {
+            encodeUtf8(&ipa, 1, ipaWord);
+            i = matchEnd;
+        } else {
+            const auto start = i;
+            decodeUtf8Char(data, len, i);
+            ipaWord.append(data + start, i - start);
         }
     }
-    return ipaWord.str();
 }
 
+// Bytes of text per task when converting a corpus
+static constexpr size_t CorpusChunk = 1 << 20;
+
+size_t Romanizer::safeSplit(
+        const std::string_view text, size_t pos, const bool romanizing) const {
+    const auto len = text.length();
+    if (romanizing) {
+        // Just don't cut a character in half
+        while (pos < len && (static_cast<unsigned char>(text[pos]) & 0xC0) == 0x80) {
+            pos++;
+        }
+        return std::min(pos, len);
+    }
+
+    // Whitespace found in some romanization could be the middle of a match
+    uint64_t breaks = (uint64_t(1) << '\n') | (uint64_t(1) << ' ') | (uint64_t(1) << '\t');
+    for (const auto &romMap : romanizationToIpa) {
+        for (const auto c : romMap.first) {
+            if (static_cast<uint32_t>(c) < 64) {
+                breaks &= ~(uint64_t(1) << c);
+            }
+        }
+    }
+    if (breaks == 0) {
+        return len;
+    }
+    while (pos < len) {
+        const auto c = static_cast<unsigned char>(text[pos]);
+        pos++;
+        if (c < 64 && ((breaks >> c) & 1)) {
+            return pos;
+        }
+    }
+    return len;
+}
+
+// Cut text into chunks of about CorpusChunk bytes, convert them in parallel and join them
+template <typename Convert>
+static void convertCorpus(
+        const Romanizer &romanizer, const std::string_view text, std::string &out,
+        Pool &pool, const bool romanizing, const Convert &convert) {
+    std::vector<std::string_view> chunks;
+    size_t pos = 0;
+    while (pos < text.length()) {
+        const auto end = romanizer.safeSplit(text, pos + CorpusChunk, romanizing);
+        chunks.push_back(text.substr(pos, end - pos));
+        pos = end;
+    }
+
+    std::vector<std::string> converted(chunks.size());
+    pool.parallelFor(chunks.size(), 1, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; i++) {
+            convert(chunks[i], converted[i]);
+        }
+    });
+
+    size_t total = 0;
+    for (const auto &chunk : converted) {
+        total += chunk.length();
+    }
+    out.reserve(out.length() + total);
+    for (const auto &chunk : converted) {
+        out.append(chunk);
+    }
+}
+
+void Romanizer::romanizeCorpus(
+        const std::string_view text, std::string &out, Pool &pool) const {
+    convertCorpus(*this, text, out, pool, true, [this](std::string_view chunk, std::string &to) {
+        romanize(chunk, to);
+    });
+}
+
+void Romanizer::unromanizeCorpus(
+        const std::string_view text, std::string &out, Pool &pool) const {
+    convertCorpus(*this, text, out, pool, false, [this](std::string_view chunk, std::string &to) {
+        unromanize(chunk, to);
+    });
+}
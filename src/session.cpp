@@ -0,0 +1,149 @@
+// Incremental re-evolution of a lexicon
+
+#include <vector>
+#include <string>
+#include <optional>
+#include <algorithm>
+#include <err.hpp>
+#include <natevolve.hpp>
+#include <sndwrp.hpp>
+#include <session.hpp>
+
+using namespace natevolve;
+using namespace sndwrp;
+
+Session::Session(
+    const std::vector<std::wstring> &words, const std::vector<SoundChange> &changes,
+    const size_t interval):
+        words(words), changes(changes), evolved(words.size()), interval(interval),
+        snapshots(
+            changes.empty() ? 0 : (changes.size() - 1) / interval,
+            std::vector<std::wstring>(words.size())
+        ) {}
+
+Result<Session> Session::create(
+        const std::vector<std::wstring> &words, const std::vector<SoundChange> &changes,
+        const size_t maxSnapshotBytes) {
+    // Space the snapshots out so that they all fit in the memory limit
+    size_t lexiconBytes = 0;
+    for (const auto &word : words) {
+        lexiconBytes += sizeof(std::wstring) + word.length() * sizeof(wchar_t);
+    }
+    const auto maxSnapshots = lexiconBytes == 0 ? changes.size() : maxSnapshotBytes / lexiconBytes;
+    size_t interval = std::max<size_t>(changes.size(), 1);
+    if (maxSnapshots > 0 && changes.size() > 1) {
+        interval = std::max<size_t>((changes.size() - 1 + maxSnapshots - 1) / maxSnapshots, 1);
+    }
+
+    Session session(words, changes, interval);
+    for (size_t w = 0; w < words.size(); w++) {
+        auto form = words[w];
+        size_t pos = 0;
+        while (pos < changes.size()) {
+            const auto next = std::min(pos + interval, changes.size());
+            const auto error = session.run(pos, next, form);
+            if (error.has_value()) {
+                return error.value();
+            }
+            pos = next;
+            if (pos < changes.size()) {
+                session.checkpoint(pos, w) = form;
+            }
+        }
+        session.evolved[w] = form;
+    }
+    return session;
+}
+
+std::wstring &Session::checkpoint(const size_t index, const size_t w) {
+    if (index == 0) {
+        return words[w];
+    }
+    return snapshots[index / interval - 1][w];
+}
+
+std::optional<Error> Session::run(const size_t first, const size_t last, std::wstring &word) {
+    for (size_t i = first; i < last; i++) {
+        const auto error = changes[i].apply(word, scratch);
+        if (error.has_value()) {
+            return error;
+        }
+        word.swap(scratch);
+    }
+    return std::nullopt;
+}
+
+Result<size_t> Session::setChange(const size_t index, const SoundChange &change) {
+    if (index >= changes.size()) {
+        return Error {
+            ErrorType::OutOfRange,
+            L"No change at index " + std::to_wstring(index)
+                + L", there are only " + std::to_wstring(changes.size())
+        };
+    }
+
+    // Changes can't be assigned over, so build the new list and swap it in
+    const auto old = changes[index];
+    std::vector<SoundChange> updated;
+    updated.reserve(changes.size());
+    for (size_t i = 0; i < changes.size(); i++) {
+        updated.push_back(i == index ? change : changes[i]);
+    }
+    changes = std::move(updated);
+
+    const auto first = (index / interval) * interval;
+    const auto stop = std::min(first + interval, changes.size());
+    size_t changedWords = 0;
+    std::wstring form;
+    std::wstring newForm;
+    std::wstring oldForm;
+    for (size_t w = 0; w < words.size(); w++) {
+        // Catch up from the checkpoint, then see if the edit makes a difference for this word
+        form.assign(checkpoint(first, w));
+        auto error = run(first, index, form);
+        if (!error.has_value()) {
+            error = changes[index].apply(form, newForm);
+        }
+        if (!error.has_value()) {
+            error = old.apply(form, oldForm);
+        }
+        if (error.has_value()) {
+            return error.value();
+        }
+        if (newForm == oldForm) {
+            continue;
+        }
+
+        form.swap(newForm);
+        error = run(index + 1, stop, form);
+        if (error.has_value()) {
+            return error.value();
+        }
+
+        // Keep going one checkpoint at a time until the word is back to what it was before
+        auto pos = stop;
+        while (true) {
+            if (pos == changes.size()) {
+                if (evolved[w] != form) {
+                    evolved[w] = form;
+                    changedWords++;
+                }
+                break;
+            }
+
+            auto &snapshot = checkpoint(pos, w);
+            if (snapshot == form) {
+                break;
+            }
+            snapshot = form;
+
+            const auto next = std::min(pos + interval, changes.size());
+            error = run(pos, next, form);
+            if (error.has_value()) {
+                return error.value();
+            }
+            pos = next;
+        }
+    }
+    return changedWords;
+}
@@ -0,0 +1,197 @@
+// Vector kernels with runtime CPU dispatch and a scalar fallback
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <simd.hpp>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NATEVOLVE_X86
+#include <immintrin.h>
+#endif
+
+using namespace natevolve;
+using namespace simd;
+
+// Unit i of an array of T, read through memcpy so data can really be any type of the same size
+template <typename T>
+static inline T loadUnit(const void *const data, const size_t i) {
+    T unit;
+    std::memcpy(&unit, static_cast<const char *>(data) + i * sizeof(T), sizeof(T));
+    return unit;
+}
+
+template <typename T>
+static size_t findUnits(const void *const data, const size_t len, size_t from, const T val) {
+    while (from < len && loadUnit<T>(data, from) != val) {
+        from++;
+    }
+    return from;
+}
+
+// Address of unit i of an array of T, for the unaligned vector loads, which may alias anything
+template <typename T>
+static inline const char *unitAt(const void *const data, const size_t i) {
+    return static_cast<const char *>(data) + i * sizeof(T);
+}
+
+#ifdef NATEVOLVE_X86
+__attribute__((target("avx2")))
+static size_t find32Avx2(
+        const void *const data, const size_t len, size_t from, const uint32_t val) {
+    const auto needle = _mm256_set1_epi32(static_cast<int>(val));
+    for (; from + 8 <= len; from += 8) {
+        const auto block = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i *>(unitAt<uint32_t>(data, from))
+        );
+        const auto mask = static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi32(block, needle))
+        );
+        if (mask != 0) {
+            return from + __builtin_ctz(mask) / 4;
+        }
+    }
+    return findUnits(data, len, from, val);
+}
+
+__attribute__((target("avx2")))
+static size_t find16Avx2(
+        const void *const data, const size_t len, size_t from, const uint16_t val) {
+    const auto needle = _mm256_set1_epi16(static_cast<short>(val));
+    for (; from + 16 <= len; from += 16) {
+        const auto block = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i *>(unitAt<uint16_t>(data, from))
+        );
+        const auto mask = static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi16(block, needle))
+        );
+        if (mask != 0) {
+            return from + __builtin_ctz(mask) / 2;
+        }
+    }
+    return findUnits(data, len, from, val);
+}
+
+__attribute__((target("sse2")))
+static size_t find32Sse2(
+        const void *const data, const size_t len, size_t from, const uint32_t val) {
+    const auto needle = _mm_set1_epi32(static_cast<int>(val));
+    for (; from + 4 <= len; from += 4) {
+        const auto block = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(unitAt<uint32_t>(data, from))
+        );
+        const auto mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi32(block, needle)));
+        if (mask != 0) {
+            return from + __builtin_ctz(mask) / 4;
+        }
+    }
+    return findUnits(data, len, from, val);
+}
+
+__attribute__((target("sse2")))
+static size_t find16Sse2(
+        const void *const data, const size_t len, size_t from, const uint16_t val) {
+    const auto needle = _mm_set1_epi16(static_cast<short>(val));
+    for (; from + 8 <= len; from += 8) {
+        const auto block = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(unitAt<uint16_t>(data, from))
+        );
+        const auto mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi16(block, needle)));
+        if (mask != 0) {
+            return from + __builtin_ctz(mask) / 2;
+        }
+    }
+    return findUnits(data, len, from, val);
+}
+
+__attribute__((target("avx2")))
+static size_t nonAsciiAvx2(const char *const data, const size_t len, size_t from) {
+    for (; from + 32 <= len; from += 32) {
+        const auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + from));
+        const auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(block));
+        if (mask != 0) {
+            return from + __builtin_ctz(mask);
+        }
+    }
+    while (from < len && static_cast<unsigned char>(data[from]) < 0x80) {
+        from++;
+    }
+    return from;
+}
+
+__attribute__((target("sse2")))
+static size_t nonAsciiSse2(const char *const data, const size_t len, size_t from) {
+    for (; from + 16 <= len; from += 16) {
+        const auto block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + from));
+        const auto mask = static_cast<uint32_t>(_mm_movemask_epi8(block));
+        if (mask != 0) {
+            return from + __builtin_ctz(mask);
+        }
+    }
+    while (from < len && static_cast<unsigned char>(data[from]) < 0x80) {
+        from++;
+    }
+    return from;
+}
+#endif
+
+static size_t nonAsciiScalar(const char *const data, const size_t len, size_t from) {
+    while (from < len && static_cast<unsigned char>(data[from]) < 0x80) {
+        from++;
+    }
+    return from;
+}
+
+static size_t find32Scalar(
+        const void *const data, const size_t len, size_t from, const uint32_t val) {
+    return findUnits(data, len, from, val);
+}
+
+static size_t find16Scalar(
+        const void *const data, const size_t len, size_t from, const uint16_t val) {
+    return findUnits(data, len, from, val);
+}
+
+static std::vector<Kernels> pickKernels(void) {
+    std::vector<Kernels> supported;
+#ifdef NATEVOLVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        supported.push_back(Kernels { find32Avx2, find16Avx2, nonAsciiAvx2, "avx2" });
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        supported.push_back(Kernels { find32Sse2, find16Sse2, nonAsciiSse2, "sse2" });
+    }
+#endif
+    supported.push_back(Kernels { find32Scalar, find16Scalar, nonAsciiScalar, "scalar" });
+    return supported;
+}
+
+// Function-local so it's safe to use from other static initializers
+const std::vector<Kernels> &natevolve::simd::supportedKernels(void) {
+    static const std::vector<Kernels> supported = pickKernels();
+    return supported;
+}
+
+static const Kernels &kernels(void) {
+    return supportedKernels().front();
+}
+
+size_t natevolve::simd::findWide32(
+        const void *const data, const size_t len, size_t from, const uint32_t val) {
+    return kernels().find32(data, len, from, val);
+}
+
+size_t natevolve::simd::findWide16(
+        const void *const data, const size_t len, size_t from, const uint16_t val) {
+    return kernels().find16(data, len, from, val);
+}
+
+size_t natevolve::simd::findNonAsciiWide(const char *const data, const size_t len, size_t from) {
+    return kernels().nonAscii(data, len, from);
+}
+
+const char *natevolve::simd::kernelName(void) {
+    return kernels().name;
+}
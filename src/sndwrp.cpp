@@ -1,284 +1,269 @@
 // API-level implementation of Soundwarp functionality
 
 #include <algorithm>
-#include <iostream>
-#include <fstream>
 #include <vector>
 #include <variant>
-#include <sstream>
 #include <string>
-#include <codecvt>
+#include <cstring>
+#include <utility>
+#include <optional>
 #include <err.hpp>
 #include <natevolve.hpp>
+#include <mapfile.hpp>
+#include <simd.hpp>
 #include <sndwrp.hpp>
 
 using namespace natevolve;
 using namespace sndwrp;
 
 SoundChange::SoundChange(
-    const wchar_t ca, const wchar_t cb,
-    const std::vector<wchar_t> &fCond, const std::vector<wchar_t> &eCond):
+    const std::wstring &ca, const std::wstring &cb,
+    const std::vector<std::wstring> &fCond, const std::vector<std::wstring> &eCond):
         a(ca), b(cb), frntCond(fCond), endCond(eCond) {}
 
-Result<std::vector<SoundChange>> SoundChange::fromFile(const char *const fileName) {
-    std::wifstream file(fileName);
-#ifdef _WIN32
-    std::locale loc(std::locale::classic(), new std::codecvt_utf8<wchar_t>);
-    file.imbue(loc);
-#endif
-    if (!file.is_open()) {
-        return Error {
-            ErrorType::FileOpen,
-            toWstr("Failed to open '" + std::string(fileName) + "'")
-        };
-    }
+SoundChange::SoundChange(
+    std::wstring &&ca, std::wstring &&cb,
+    std::vector<std::wstring> &&fCond, std::vector<std::wstring> &&eCond):
+        a(std::move(ca)), b(std::move(cb)),
+        frntCond(std::move(fCond)), endCond(std::move(eCond)) {}
 
-    std::vector<SoundChange> changes;
-    size_t ln = 1;
-    size_t col = 1;
-    std::wstring line;
-    while (std::getline(file, line)) {
-        if (line.empty()) {
-            ln++;
-            continue;
+// Whether the sound in word[start, end) is one of the sounds in a condition
+static inline bool inCond(
+        const std::vector<std::wstring> &cond,
+        const std::wstring &word, const size_t start, const size_t end) {
+    for (const auto &sound : cond) {
+        if (sound.length() == end - start && word.compare(start, end - start, sound) == 0) {
+            return true;
         }
+    }
+    return false;
+}
 
-        wchar_t a = L'\0';
-        wchar_t b = L'\0';
-        std::vector<wchar_t> frntCond;
-        std::vector<wchar_t> endCond;
+static inline bool hasBoundary(const std::vector<std::wstring> &cond) {
+    return std::count(cond.begin(), cond.end(), L"#") > 0;
+}
 
-        col = 1;
-        while (col - 1 < line.length() && (line[col - 1] == ' ' || line[col - 1] == '\t')) {
-            col++;
-        }
+static inline bool isSpace(const wchar_t c) {
+    return c == L' ' || c == L'\t';
+}
 
-        // Get the first phoneme
-        if (col - 1 >= line.length()) {
-            return Error {
-                ErrorType::FileFormat,
-                toWstr(
-                    "Expected phoneme in '" + std::string(fileName)
-                        + "' at line " + std::to_string(ln) + ", col " + std::to_string(col)
-                )
-            };
+// Parse the change on text[pos, end), which is line ln of the file.
+// Adds it to changes, or a description of the first thing wrong with it to errors.
+// Conditions are gathered in reused buffers so each only needs one exact-sized allocation
+static void parseLine(
+        const std::wstring &text, size_t pos, const size_t end, const size_t ln,
+        const std::wstring &fileName,
+        std::vector<std::wstring> &frntCond, std::vector<std::wstring> &endCond,
+        std::vector<SoundChange> &changes, std::vector<Error> &errors) {
+    const auto lineStart = pos;
+    const auto skipSpace = [&]() {
+        while (pos < end && isSpace(text[pos])) {
+            pos++;
         }
-        a = line[col - 1];
-        col++;
-        while (col - 1 < line.length() && (line[col - 1] == ' ' || line[col - 1] == '\t')) {
-            col++;
+    };
+    const auto fail = [&](const wchar_t *const expected) {
+        errors.push_back(Error {
+            ErrorType::FileFormat,
+            std::wstring(expected) + L" in '" + fileName + L"' at line " + std::to_wstring(ln)
+                + L", col " + std::to_wstring(pos - lineStart + 1)
+        });
+    };
+    const auto readSound = [&]() {
+        const auto soundEnd = segmentEnd(text.data(), end, pos);
+        std::wstring sound(text, pos, soundEnd - pos);
+        pos = soundEnd;
+        skipSpace();
+        return sound;
+    };
+    const auto expect = [&](const wchar_t c, const wchar_t *const message) {
+        if (pos >= end || text[pos] != c) {
+            fail(message);
+            return false;
         }
-
-        // Then the '>'
-        if (col - 1 >= line.length() || line[col - 1] != L'>') {
-            return Error {
-                ErrorType::FileFormat,
-                toWstr(
-                    "Expected '>' in '" + std::string(fileName)
-                        + "' at line " + std::to_string(ln) + ", col " + std::to_string(col)
-                )
-            };
+        pos++;
+        skipSpace();
+        return true;
+    };
+    const auto readCond = [&](std::vector<std::wstring> &cond) {
+        if (!expect(L'{', L"Expected '{'")) {
+            return false;
         }
-        col++;
-        while (col - 1 < line.length() && (line[col - 1] == L' ' || line[col - 1] == L'\t')) {
-            col++;
+        while (pos < end && text[pos] != L'}') {
+            cond.push_back(readSound());
         }
+        return expect(L'}', L"Expected '}'");
+    };
 
-        // Get the second phoneme
-        if (col - 1 >= line.length()) {
-            return Error {
-                ErrorType::FileFormat,
-                toWstr(
-                    "Expected phoneme in '" + std::string(fileName)
-                        + "' at line " + std::to_string(ln) + ", col " + std::to_string(col)
-                )
-            };
-        }
-        b = line[col - 1];
-        col++;
-        while (col - 1 < line.length() && (line[col - 1] == L' ' || line[col - 1] == L'\t')) {
-            col++;
-        }
+    skipSpace();
+    if (pos >= end) {
+        fail(L"Expected phoneme");
+        return;
+    }
+    auto a = readSound();
+    if (!expect(L'>', L"Expected '>'")) {
+        return;
+    }
+    if (pos >= end) {
+        fail(L"Expected phoneme");
+        return;
+    }
+    auto b = readSound();
+    frntCond.clear();
+    endCond.clear();
+    if (!expect(L'/', L"Expected '/'") || !readCond(frntCond)
+            || !expect(L'_', L"Expected '_'") || !readCond(endCond)) {
+        return;
+    }
+    if (pos != end) {
+        errors.push_back(Error {
+            ErrorType::FileFormat,
+            L"Extra characters in '" + fileName + L"' on line " + std::to_wstring(ln)
+        });
+        return;
+    }
+    changes.emplace_back(
+        std::move(a), std::move(b),
+        std::vector<std::wstring>(frntCond.begin(), frntCond.end()),
+        std::vector<std::wstring>(endCond.begin(), endCond.end())
+    );
+}
 
-        // Get the '/'
-        if (col - 1 >= line.length() || line[col - 1] != L'/') {
-            return Error {
-                ErrorType::FileFormat,
-                toWstr(
-                    "Expected '/' in '" + std::string(fileName)
-                        + "' at line " + std::to_string(ln) + ", col " + std::to_string(col)
-                )
-            };
-        }
-        col++;
-        while (col - 1 < line.length() && (line[col - 1] == L' ' || line[col - 1] == L'\t')) {
-            col++;
-        }
+Result<std::vector<SoundChange>> SoundChange::fromFile(const char *const fileName) {
+    std::vector<Error> errors;
+    auto changes = fromFile(fileName, errors);
+    if (errors.empty()) {
+        return changes;
+    }
 
-        // Get the {
-        if (col - 1 >= line.length() || line[col - 1] != L'{') {
-            return Error {
-                ErrorType::FileFormat,
-                toWstr(
-                    "Expected '{' in '" + std::string(fileName)
-                        + "' at line " + std::to_string(ln) + ", col " + std::to_string(col)
-                )
-            };
-        }
-        col++;
-        while (col - 1 < line.length() && (line[col - 1] == L' ' || line[col - 1] == L'\t')) {
-            col++;
-        }
+    // Report everything at once, one problem per line
+    auto error = errors[0];
+    for (size_t i = 1; i < errors.size(); i++) {
+        error.message += L"\n" + errors[i].message;
+    }
+    return error;
+}
 
-        // Get the front condition up to '}'
-        if (col - 1 >= line.length()) {
-            return Error {
-                ErrorType::FileFormat,
-                toWstr(
-                    "Expected '}' at line " + std::to_string(ln) + ", col " + std::to_string(col)
-                )
-            };
-        }
-        while (line[col - 1] != L'}') {
-            frntCond.push_back(line[col - 1]);
-            col++;
-            while (col - 1 < line.length() && (line[col - 1] == L' ' || line[col - 1] == L'\t')) {
-                col++;
-            }
-            if (col - 1 >= line.length()) {
-                return Error {
-                    ErrorType::FileFormat,
-                    toWstr(
-                        "Expected '}' in '" + std::string(fileName)
-                            + "' at line " + std::to_string(ln) + ", col " + std::to_string(col)
-                    )
-                };
-            }
-        }
-        col++;
-        while (col - 1 < line.length() && (line[col - 1] == L' ' || line[col - 1] == L'\t')) {
-            col++;
-        }
+std::vector<SoundChange> SoundChange::fromFile(
+        const char *const fileName, std::vector<Error> &errors) {
+    std::wstring name;
+    decodeUtf8(fileName, std::strlen(fileName), name);
 
-        // Get the '_'
-        if (col - 1 >= line.length() || line[col - 1] != L'_') {
-            return Error {
-                ErrorType::FileFormat,
-                toWstr(
-                    "Expected '_' in '" + std::string(fileName)
-                        + "' at line " + std::to_string(ln) + ", col " + std::to_string(col)
-                )
-            };
-        }
-        col++;
-        while (col - 1 < line.length() && (line[col - 1] == L' ' || line[col - 1] == L'\t')) {
-            col++;
-        }
+    MappedFile file;
+    const auto openError = file.open(fileName);
+    if (openError.has_value()) {
+        errors.push_back(openError.value());
+        return {};
+    }
 
-        // Get the second {
-        if (col - 1 >= line.length() || line[col - 1] != L'{') {
-            return Error {
-                ErrorType::FileFormat,
-                toWstr(
-                    "Expected '{' in '" + std::string(fileName)
-                        + "' at line " + std::to_string(ln) + ", col " + std::to_string(col)
-                )
-            };
-        }
-        col++;
-        while (col - 1 < line.length() && (line[col - 1] == L' ' || line[col - 1] == L'\t')) {
-            col++;
-        }
+    // Decoding the whole file up front keeps the scan below one linear pass over wchar_ts
+    std::wstring text;
+    text.reserve(file.size);
+    decodeUtf8(file.data, file.size, text);
+    file.close();
 
-        // Get the end condition
-        if (col - 1 >= line.length()) {
-            return Error {
-                ErrorType::FileFormat,
-                toWstr(
-                    "Expected '}' in '" + std::string(fileName)
-                        + "' at line " + std::to_string(ln) + ", col " + std::to_string(col)
-                )
-            };
-        }
-        while (line[col - 1] != L'}') {
-            endCond.push_back(line[col - 1]);
-            col++;
-            while (col - 1 < line.length() && (line[col - 1] == L' ' || line[col - 1] == L'\t')) {
-                col++;
-            }
-            if (col - 1 >= line.length()) {
-                return Error {
-                    ErrorType::FileFormat,
-                    toWstr(
-                        "Expected '}' in '" + std::string(fileName)
-                            + "' at line " + std::to_string(ln) + ", col " + std::to_string(col)
-                    )
-                };
-            }
+    // SoundChange can't be moved, so growing the vector would copy every change parsed so far
+    std::vector<SoundChange> changes;
+    changes.reserve(std::count(text.begin(), text.end(), L'\n') + 1);
+    std::vector<std::wstring> frntCond;
+    std::vector<std::wstring> endCond;
+    size_t pos = !text.empty() && text[0] == 0xFEFF ? 1 : 0;
+    size_t ln = 1;
+    while (pos < text.length()) {
+        auto end = text.find(L'\n', pos);
+        if (end == std::wstring::npos) {
+            end = text.length();
         }
-        col++;
-        while (col - 1 < line.length() && (line[col - 1] == L' ' || line[col - 1] == L'\t')) {
-            col++;
+        const auto next = end + 1;
+        if (end > pos && text[end - 1] == L'\r') {
+            end--;
         }
-
-        if (col - 1 != line.length()) {
-            return Error {
-                ErrorType::FileFormat,
-                toWstr(
-                    "Extra characters in '" + std::string(fileName) + "' on line "
-                        + std::to_string(ln)
-                )
-            };
+        if (end > pos) {
+            parseLine(text, pos, end, ln, name, frntCond, endCond, changes, errors);
         }
-
-        changes.push_back(SoundChange(a, b, frntCond, endCond));
+        pos = next;
         ln++;
     }
-
-    if (file.bad()) {
-        return Error {
-            ErrorType::FileRead,
-            toWstr(
-                "Failed to read '" + std::string(fileName)
-                    + "' at line " + std::to_string(ln) + ", col " + std::to_string(col)
-            )
-        };
-    }
-
-    file.close();
     return changes;
 }
 
 Result<std::wstring> SoundChange::apply(const std::wstring &word) const {
-    std::wstringstream changedWord;
-    for (size_t i = 0; i < word.length(); i++) {
-        const bool correctSound = word[i] == a;
+    std::wstring changedWord;
+    const auto error = apply(word, changedWord);
+    if (error.has_value()) {
+        return error.value();
+    }
+    return changedWord;
+}
+
+std::optional<Error> SoundChange::apply(const std::wstring &word, std::wstring &out) const {
+    out.clear();
+    const auto len = word.length();
+    if (a.empty()) {
+        out.append(word);
+        return std::nullopt;
+    }
+
+    // Only positions holding the target sound can change, so jump straight between them
+    // and copy everything in between as-is
+    size_t copied = 0;
+    for (size_t i = simd::find(word.data(), len, 0, a[0]); i < len;
+            i = simd::find(word.data(), len, i + 1, a[0])) {
+        if (!isSegmentStart(word.data(), i)) {
+            continue;
+        }
+        const auto end = segmentEnd(word.data(), len, i);
+        if (end - i != a.length() || word.compare(i, a.length(), a) != 0) {
+            continue;
+        }
+
         const bool frontCondFulfilled =
-            (i == 0 && std::count(frntCond.begin(), frntCond.end(), L'#') > 0)
-                || (i > 0 && std::count(frntCond.begin(), frntCond.end(), word[i - 1]) > 0)
+            (i == 0 && hasBoundary(frntCond))
+                || (i > 0 && inCond(frntCond, word, segmentStart(word.data(), i), i))
                 || frntCond.empty();
-        const bool endCondFulfilled =
-            (i == word.length() - 1 && std::count(endCond.begin(), endCond.end(), L'#') > 0)
-                || (
-                    i + 1 < word.length()
-                        && std::count(endCond.begin(), endCond.end(), word[i + 1]) > 0
-                ) || endCond.empty();
-        const auto c = (correctSound && frontCondFulfilled && endCondFulfilled) ? b : word[i];
-        changedWord << c;
+        const bool endCondFulfilled = frontCondFulfilled && (
+            (end == len && hasBoundary(endCond))
+                || (end < len && inCond(endCond, word, end, segmentEnd(word.data(), len, end)))
+                || endCond.empty()
+        );
+        if (frontCondFulfilled && endCondFulfilled) {
+            out.append(word, copied, i - copied);
+            out.append(b);
+            copied = end;
+        }
     }
-    return changedWord.str();
+    out.append(word, copied, len - copied);
+    return std::nullopt;
 }
 
 Result<std::wstring> natevolve::sndwrp::applyAllChanges(
         const std::wstring &word, const std::vector<SoundChange> &changes) {
-    auto changedWord = word;
-    for (const auto &change : changes) {
-        const auto result = change.apply(changedWord);
-        if (isErr(result)) {
-            return err(result);
-        }
-        changedWord = ok(result);
+    std::wstring changedWord;
+    std::wstring scratch;
+    const auto error = applyAllChanges(word, changes, changedWord, scratch);
+    if (error.has_value()) {
+        return error.value();
     }
     return changedWord;
 }
 
+std::optional<Error> natevolve::sndwrp::applyAllChanges(
+        const std::wstring &word, const std::vector<SoundChange> &changes,
+        std::wstring &out, std::wstring &scratch) {
+    if (changes.empty()) {
+        out.assign(word);
+        return std::nullopt;
+    }
+
+    // Pick the first buffer so that the last change writes into out
+    const std::wstring *src = &word;
+    std::wstring *dest = (changes.size() % 2 == 1) ? &out : &scratch;
+    for (const auto &change : changes) {
+        const auto error = change.apply(*src, *dest);
+        if (error.has_value()) {
+            return error;
+        }
+        src = dest;
+        dest = (dest == &out) ? &scratch : &out;
+    }
+    return std::nullopt;
+}
@@ -0,0 +1,181 @@
+// Lazily built transducer for a whole Soundwarp cascade
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <err.hpp>
+#include <sndwrp.hpp>
+#include <transducer.hpp>
+
+using namespace natevolve;
+using namespace sndwrp;
+
+// Bits making up the state of the machine for a single change
+static constexpr char FrontFulfilled = 1; // The next sound will have its front condition met
+static constexpr char Held = 2; // A sound matching the change is waiting on its end condition
+static constexpr char HeldFrontFulfilled = 4; // The held sound had its front condition met
+
+static constexpr uint32_t Unknown = UINT32_MAX;
+
+static inline bool testBit(
+        const std::vector<uint64_t> &bits, const size_t offset, const uint16_t id) {
+    return (bits[offset + (id >> 6)] >> (id & 63)) & 1;
+}
+
+// Feed one sound to the machine for a single change
+static inline void stepChange(
+        const Cascade &cascade, const CompiledChange &change,
+        char &state, const uint16_t id, std::vector<uint16_t> &out) {
+    if (state & Held) {
+        const bool endCondFulfilled = change.endAny || testBit(cascade.bits, change.endBits, id);
+        out.push_back(((state & HeldFrontFulfilled) && endCondFulfilled) ? change.b : change.a);
+        state &= ~(Held | HeldFrontFulfilled);
+    }
+    if (id == change.a && !change.endAny) {
+        state |= (state & FrontFulfilled) ? (Held | HeldFrontFulfilled) : Held;
+    } else {
+        out.push_back((id == change.a && (state & FrontFulfilled)) ? change.b : id);
+    }
+    if (change.frntAny || testBit(cascade.bits, change.frntBits, id)) {
+        state |= FrontFulfilled;
+    } else {
+        state &= ~FrontFulfilled;
+    }
+}
+
+// Tell the machine for a single change that the word is over
+static inline void finishChange(
+        const CompiledChange &change, const char state, std::vector<uint16_t> &out) {
+    if (state & Held) {
+        const bool endCondFulfilled = change.endAny || change.endBoundary;
+        out.push_back(((state & HeldFrontFulfilled) && endCondFulfilled) ? change.b : change.a);
+    }
+}
+
+Transducer::Transducer(const std::vector<SoundChange> &changes, const size_t maxStates):
+        cascade(changes), maxStates(maxStates < 2 ? 2 : maxStates), generation(0) {
+    reset();
+}
+
+size_t Transducer::stateCount(void) const {
+    return stateKeys.size();
+}
+
+// Drop every cached state and start over from the initial one, which is always id 0
+void Transducer::reset(void) {
+    stateKeys.clear();
+    stateIds.clear();
+    edges.clear();
+    finals.clear();
+    outputs.clear();
+    generation++;
+
+    std::string initial(cascade.changes.size(), 0);
+    for (size_t i = 0; i < cascade.changes.size(); i++) {
+        const auto &change = cascade.changes[i];
+        if (change.frntAny || change.frntBoundary) {
+            initial[i] = FrontFulfilled;
+        }
+    }
+    intern(initial);
+}
+
+uint32_t Transducer::intern(const std::string &key) {
+    const auto found = stateIds.find(key);
+    if (found != stateIds.end()) {
+        return found->second;
+    }
+    if (stateKeys.size() >= maxStates) {
+        reset();
+        return intern(key);
+    }
+
+    const auto id = static_cast<uint32_t>(stateKeys.size());
+    stateKeys.push_back(key);
+    stateIds.insert({ key, id });
+    edges.resize(edges.size() + cascade.inventory.sounds.size(), Edge { Unknown, 0, 0 });
+    finals.push_back(Edge { Unknown, 0, 0 });
+    return id;
+}
+
+// Run sounds through every change in order, updating the composed state in key.
+// Whatever comes out of the last change ends up in produced
+void Transducer::simulate(
+        std::string &key, const uint16_t *input, const size_t len, const bool end) {
+    produced.assign(input, input + len);
+    for (size_t i = 0; i < cascade.changes.size(); i++) {
+        const auto &change = cascade.changes[i];
+        pending.swap(produced);
+        produced.clear();
+        auto state = key[i];
+        for (const auto id : pending) {
+            stepChange(cascade, change, state, id, produced);
+        }
+        if (end) {
+            finishChange(change, state, produced);
+        }
+        key[i] = state;
+    }
+}
+
+uint32_t Transducer::step(const uint32_t state, const uint16_t id) {
+    const auto row = static_cast<size_t>(state) * cascade.inventory.sounds.size();
+    const auto &edge = edges[row + id];
+    if (edge.next != Unknown) {
+        changedIds.insert(
+            changedIds.end(), outputs.begin() + edge.outBegin, outputs.begin() + edge.outEnd
+        );
+        return edge.next;
+    }
+
+    auto key = stateKeys[state];
+    simulate(key, &id, 1, false);
+    changedIds.insert(changedIds.end(), produced.begin(), produced.end());
+
+    // Interning can drop the whole cache, in which case there's no row left to fill in
+    const auto oldGeneration = generation;
+    const auto next = intern(key);
+    if (generation == oldGeneration) {
+        const auto outBegin = static_cast<uint32_t>(outputs.size());
+        outputs.insert(outputs.end(), produced.begin(), produced.end());
+        edges[row + id] = Edge { next, outBegin, static_cast<uint32_t>(outputs.size()) };
+    }
+    return next;
+}
+
+void Transducer::finish(const uint32_t state) {
+    auto &flush = finals[state];
+    if (flush.next == Unknown) {
+        auto key = stateKeys[state];
+        simulate(key, nullptr, 0, true);
+        flush = Edge { 0, static_cast<uint32_t>(outputs.size()), 0 };
+        outputs.insert(outputs.end(), produced.begin(), produced.end());
+        flush.outEnd = static_cast<uint32_t>(outputs.size());
+    }
+    changedIds.insert(
+        changedIds.end(), outputs.begin() + flush.outBegin, outputs.begin() + flush.outEnd
+    );
+}
+
+Result<std::wstring> Transducer::apply(const std::wstring &word) {
+    std::wstring changedWord;
+    const auto error = apply(word, changedWord);
+    if (error.has_value()) {
+        return error.value();
+    }
+    return changedWord;
+}
+
+std::optional<Error> Transducer::apply(const std::wstring &word, std::wstring &out) {
+    cascade.inventory.tokenize(word, ids);
+    changedIds.clear();
+    uint32_t state = 0;
+    for (const auto id : ids) {
+        state = step(state, id);
+    }
+    finish(state);
+    cascade.inventory.detokenize(changedIds, word, out);
+    return std::nullopt;
+}
@@ -1,16 +1,25 @@
 // Implement wordup functionality
 
 #include <random>
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <map>
 #include <iostream>
 #include <sstream>
+#include <cmath>
+#include <cstdint>
+#include <locale>
 #include <fstream>
 #include <optional>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <string_view>
 #include <codecvt>
 #include <err.hpp>
 #include <natevolve.hpp>
+#include <pool.hpp>
 #include <wordup.hpp>
 
 using namespace natevolve;
@@ -21,9 +30,56 @@ enum class FileParseState {
     Vowels,
     Onsets,
     Codas,
+    Syllables,
     End
 };
 
+// Read a whole number, ignoring whitespace after it
+static bool parseNumber(const std::wstring &text, double &number) {
+    std::wistringstream in(text);
+    in.imbue(std::locale::classic());
+    in >> number;
+    if (in.fail()) {
+        return false;
+    }
+    in >> std::ws;
+    return in.eof();
+}
+
+// Split a ':weight' off of the end of token, leaving the weight at 1 if there isn't one.
+// A ':' not followed by a number is part of the token, like the length mark in a:.
+// Gives false if what comes after the ':' is a number but negative or not finite
+static bool splitWeight(std::wstring &token, double &weight) {
+    weight = 1;
+    const auto colon = token.rfind(L':');
+    if (colon == std::wstring::npos || !parseNumber(token.substr(colon + 1), weight)) {
+        weight = 1;
+        return true;
+    }
+    if (!std::isfinite(weight) || weight < 0) {
+        return false;
+    }
+    token.erase(colon);
+    return true;
+}
+
+// Write a weight with as few digits as still read back the same
+static std::wstring formatWeight(const double weight) {
+    std::wstring text;
+    for (int precision = 1; precision <= 17; precision++) {
+        std::wostringstream out;
+        out.imbue(std::locale::classic());
+        out.precision(precision);
+        out << weight;
+        text = out.str();
+        double back = 0;
+        if (parseNumber(text, back) && back == weight) {
+            break;
+        }
+    }
+    return text;
+}
+
 Result<Generator> Generator::fromFile(const char *const fileName) {
     std::wifstream file(fileName);
 #ifdef _WIN32
@@ -41,10 +97,18 @@ Result<Generator> Generator::fromFile(const char *const fileName) {
     std::vector<std::wstring> vowels;
     std::vector<std::vector<std::wstring>> onsetOptions;
     std::vector<std::vector<std::wstring>> codaOptions;
+    Weights weights;
     size_t ln = 1;
     size_t col = 1;
     std::wstring line;
     auto state = FileParseState::Categories;
+    const auto badWeight = [&]() {
+        return Error {
+            ErrorType::FileFormat,
+            L"Expected a weight of 0 or more after ':' in '" + toWstr(std::string(fileName))
+                + L"' on line " + std::to_wstring(ln)
+        };
+    };
     while (std::getline(file, line)) {
         if (line.empty()) {
             ln++;
@@ -52,6 +116,7 @@ Result<Generator> Generator::fromFile(const char *const fileName) {
         }
 
         if (line == L"#") {
+            ln++;
             state = static_cast<FileParseState>(static_cast<size_t>(state) + 1);
             if (state == FileParseState::End) {
                 // We should reach EOF, not a final #
@@ -114,6 +179,7 @@ Result<Generator> Generator::fromFile(const char *const fileName) {
 
                 // Get the onset character options
                 std::vector<std::wstring> sounds;
+                std::vector<double> soundWeights;
                 if (col - 1 >= line.length()) {
                     return Error {
                         ErrorType::FileFormat,
@@ -136,7 +202,13 @@ Result<Generator> Generator::fromFile(const char *const fileName) {
                             && (line[col - 1] == ' ' || line[col - 1] == '\t')) {
                         col++;
                     }
-                    sounds.push_back(sound.str());
+                    auto soundText = sound.str();
+                    double weight = 1;
+                    if (!splitWeight(soundText, weight)) {
+                        return badWeight();
+                    }
+                    sounds.push_back(soundText);
+                    soundWeights.push_back(weight);
 
                     if (col - 1 >= line.length()) {
                         return Error {
@@ -161,16 +233,28 @@ Result<Generator> Generator::fromFile(const char *const fileName) {
                     };
                 }
 
+                weights.sounds.insert({ name.str(), soundWeights });
                 categories.insert({ name.str(), sounds });
                 break;
             }
 
-            case FileParseState::Vowels:
-                vowels.push_back(line);
+            case FileParseState::Vowels: {
+                auto vowel = line;
+                double weight = 1;
+                if (!splitWeight(vowel, weight)) {
+                    return badWeight();
+                }
+                vowels.push_back(vowel);
+                weights.vowels.push_back(weight);
                 break;
+            }
 
-            case FileParseState::Onsets: {
+            case FileParseState::Onsets:
+            case FileParseState::Codas: {
+                const auto onset = state == FileParseState::Onsets;
                 std::vector<std::wstring> option;
+                double weight = 1;
+                auto weighted = false;
                 while (col - 1 < line.length()) {
                     std::wstringstream cat;
                     while (col - 1 < line.length()
@@ -182,28 +266,58 @@ Result<Generator> Generator::fromFile(const char *const fileName) {
                             && (line[col - 1] == ' ' || line[col - 1] == '\t')) {
                         col++;
                     }
-                    option.push_back(cat.str());
+
+                    // The option's weight comes last, as its own ':weight'
+                    auto catText = cat.str();
+                    if (weighted) {
+                        return Error {
+                            ErrorType::FileFormat,
+                            L"Expected the weight to be last in '"
+                                + toWstr(std::string(fileName))
+                                + L"' on line " + std::to_wstring(ln)
+                        };
+                    }
+                    if (catText[0] == L':') {
+                        if (!splitWeight(catText, weight)) {
+                            return badWeight();
+                        }
+                        if (catText.empty()) {
+                            weighted = true;
+                            continue;
+                        }
+                    }
+                    option.push_back(catText);
                 }
-                onsetOptions.push_back(option);
+                (onset ? onsetOptions : codaOptions).push_back(option);
+                (onset ? weights.onsets : weights.codas).push_back(weight);
                 break;
             }
 
-            case FileParseState::Codas: {
-                std::vector<std::wstring> option;
-                while (col - 1 < line.length()) {
-                    std::wstringstream cat;
-                    while (col - 1 < line.length()
-                            && (line[col - 1] != L' ' && line[col - 1] != L'\t')) {
-                        cat << line[col - 1];
-                        col++;
-                    }
-                    while (col - 1 < line.length()
-                            && (line[col - 1] == ' ' || line[col - 1] == '\t')) {
-                        col++;
+            case FileParseState::Syllables: {
+                auto count = line.substr(col - 1);
+                double weight = 1;
+                if (!splitWeight(count, weight)) {
+                    return badWeight();
+                }
+                while (!count.empty() && (count.back() == L' ' || count.back() == L'\t')) {
+                    count.pop_back();
+                }
+                size_t syllables = 0;
+                for (const auto c : count) {
+                    if (c < L'0' || c > L'9') {
+                        syllables = 0;
+                        break;
                     }
-                    option.push_back(cat.str());
+                    syllables = syllables * 10 + (c - L'0');
                 }
-                codaOptions.push_back(option);
+                if (syllables == 0) {
+                    return Error {
+                        ErrorType::FileFormat,
+                        L"Expected a syllable count in '" + toWstr(std::string(fileName))
+                            + L"' on line " + std::to_wstring(ln)
+                    };
+                }
+                weights.syllables.push_back({ syllables, weight });
                 break;
             }
         }
@@ -220,64 +334,775 @@ Result<Generator> Generator::fromFile(const char *const fileName) {
     }
 
     file.close();
-    return Generator(categories, vowels, onsetOptions, codaOptions);
+    return Generator(categories, vowels, onsetOptions, codaOptions, weights);
+}
+
+static uint64_t saturatingAdd(const uint64_t a, const uint64_t b) {
+    return a > UINT64_MAX - b ? UINT64_MAX : a + b;
+}
+
+static uint64_t saturatingMul(const uint64_t a, const uint64_t b) {
+    return b != 0 && a > UINT64_MAX / b ? UINT64_MAX : a * b;
+}
+
+AliasTable::AliasTable(const std::vector<double> &weights): even(true) {
+    double total = 0;
+    for (uint32_t i = 0; i < weights.size(); i++) {
+        entries.push_back(Entry { UINT32_MAX, i });
+        total += std::max(weights[i], 0.0);
+        even = even && weights[i] == weights[0];
+    }
+    if (even || !(total > 0)) {
+        even = true;
+        return;
+    }
+
+    // Scale the weights so they average 1, then top up every choice under 1 with part of one
+    // over 1. Whatever is left at the end is 1 up to rounding, so it always stays itself
+    std::vector<double> scaled;
+    std::vector<uint32_t> under;
+    std::vector<uint32_t> over;
+    for (uint32_t i = 0; i < weights.size(); i++) {
+        scaled.push_back(std::max(weights[i], 0.0) * weights.size() / total);
+        (scaled[i] < 1 ? under : over).push_back(i);
+    }
+    while (!under.empty() && !over.empty()) {
+        const auto less = under.back();
+        under.pop_back();
+        const auto more = over.back();
+        entries[less] = Entry {
+            static_cast<uint32_t>(std::min(scaled[less] * 4294967296.0, 4294967295.0)), more
+        };
+        scaled[more] -= 1 - scaled[less];
+        if (scaled[more] < 1) {
+            over.pop_back();
+            under.push_back(more);
+        }
+    }
+}
+
+// Chance of picking each choice, treating the weights the same way AliasTable does
+static std::vector<double> chances(const std::vector<double> &weights) {
+    double total = 0;
+    bool even = true;
+    for (const auto weight : weights) {
+        total += std::max(weight, 0.0);
+        even = even && weight == weights[0];
+    }
+    std::vector<double> result;
+    for (const auto weight : weights) {
+        result.push_back(
+            even || !(total > 0) ? 1.0 / weights.size() : std::max(weight, 0.0) / total
+        );
+    }
+    return result;
+}
+
+// Fill in every weight a generator needs, so each list lines up with what it weighs
+static Weights fillWeights(
+        const Weights &wts, const std::map<std::wstring, std::vector<std::wstring>> &cats,
+        const std::vector<std::wstring> &vwls,
+        const std::vector<std::vector<std::wstring>> &onsets,
+        const std::vector<std::vector<std::wstring>> &codas) {
+    const auto fill = [](const std::vector<double> &given, const size_t count) {
+        return given.size() == count ? given : std::vector<double>(count, 1);
+    };
+    Weights filled;
+    for (const auto &cat : cats) {
+        const auto found = wts.sounds.find(cat.first);
+        const auto &given = found == wts.sounds.end() ? std::vector<double>() : found->second;
+        filled.sounds.insert({ cat.first, fill(given, cat.second.size()) });
+    }
+    filled.vowels = fill(wts.vowels, vwls.size());
+    filled.onsets = fill(wts.onsets, onsets.size());
+    filled.codas = fill(wts.codas, codas.size());
+
+    // Shortest words first, with repeated counts merged
+    std::map<size_t, double> syllables;
+    for (const auto &count : wts.syllables) {
+        if (count.first > 0) {
+            syllables[count.first] += count.second;
+        }
+    }
+    if (syllables.empty()) {
+        syllables[1] = 1;
+    }
+    filled.syllables.assign(syllables.begin(), syllables.end());
+    return filled;
 }
 
 Generator::Generator(
     const std::map<std::wstring, std::vector<std::wstring>> &cats,
     const std::vector<std::wstring> &vwls,
     const std::vector<std::vector<std::wstring>> &onsets,
-    const std::vector<std::vector<std::wstring>> &codas):
-        categories(cats), vowels(vwls), onsetOptions(onsets), codaOptions(codas) {}
+    const std::vector<std::vector<std::wstring>> &codas,
+    const Weights &wts):
+        categories(cats), vowels(vwls), onsetOptions(onsets), codaOptions(codas),
+        weights(fillWeights(wts, cats, vwls, onsets, codas)) {
+    // Pool the sounds of every category, then the vowels as the last one
+    std::map<std::wstring, uint32_t> catIndices;
+    std::vector<size_t> longest;
+    const auto addCategory = [&](
+            const std::vector<std::wstring> &sounds, const std::vector<double> &soundWeights) {
+        categorySounds.push_back(soundOffsets.size());
+        categoryTables.push_back(AliasTable(soundWeights));
+        const auto soundChanceList = chances(soundWeights);
+        soundChances.insert(soundChances.end(), soundChanceList.begin(), soundChanceList.end());
+        size_t len = 0;
+        for (const auto &sound : sounds) {
+            soundOffsets.push_back(soundPool.length());
+            soundPool += sound;
+            len = std::max(len, sound.length());
+        }
+        longest.push_back(len);
+    };
+    for (const auto &cat : categories) {
+        catIndices.insert({ cat.first, static_cast<uint32_t>(categorySounds.size()) });
+        addCategory(cat.second, weights.sounds.at(cat.first));
+    }
+    vowelCategory = categorySounds.size();
+    addCategory(vowels, weights.vowels);
+    categorySounds.push_back(soundOffsets.size());
+    soundOffsets.push_back(soundPool.length());
 
+    // Resolve the category names of every option, stopping at ∅ like generate always has
+    const auto resolve = [&](
+            const std::vector<std::vector<std::wstring>> &options,
+            std::vector<uint32_t> &resolved, std::vector<uint32_t> &offsets) {
+        size_t len = 0;
+        for (const auto &opt : options) {
+            offsets.push_back(resolved.size());
+            size_t optLen = 0;
+            for (const auto &cat : opt) {
+                if (cat == L"∅") {
+                    break;
+                }
+                const auto found = catIndices.find(cat);
+                if (found == catIndices.end()) {
+                    resolved.push_back(MissingCategory);
+                    continue;
+                }
+                resolved.push_back(found->second);
+                optLen += longest[found->second];
+            }
+            len = std::max(len, optLen);
+        }
+        offsets.push_back(resolved.size());
+        return len;
+    };
+    maxLength = resolve(onsetOptions, onsetCategories, onsetOffsets)
+        + longest[vowelCategory]
+        + resolve(codaOptions, codaCategories, codaOffsets);
+    maxLength *= weights.syllables.back().first;
+    onsetTable = AliasTable(weights.onsets);
+    codaTable = AliasTable(weights.codas);
+    std::vector<double> syllableWeights;
+    for (const auto &count : weights.syllables) {
+        syllableWeights.push_back(count.second);
+    }
+    syllableTable = AliasTable(syllableWeights);
+    onsetChances = chances(weights.onsets);
+    codaChances = chances(weights.codas);
+    lengthChances = chances(syllableWeights);
+
+    // Count the ways to build every option. An undefined category can't build anything
+    const auto countWays = [&](
+            const std::vector<uint32_t> &resolved, const std::vector<uint32_t> &offsets,
+            std::vector<uint64_t> &strides, std::vector<uint64_t> &starts) {
+        strides.resize(resolved.size());
+        starts.push_back(0);
+        for (size_t opt = 0; opt + 1 < offsets.size(); opt++) {
+            uint64_t ways = 1;
+            for (auto i = offsets[opt + 1]; i-- > offsets[opt];) {
+                strides[i] = ways;
+                const auto cat = resolved[i];
+                ways = cat == MissingCategory
+                    ? 0
+                    : saturatingMul(ways, categorySounds[cat + 1] - categorySounds[cat]);
+            }
+            starts.push_back(saturatingAdd(starts.back(), ways));
+        }
+        return starts.back();
+    };
+    const auto onsetWays = countWays(onsetCategories, onsetOffsets, onsetStrides, onsetStarts);
+    const auto codaWays = countWays(codaCategories, codaOffsets, codaStrides, codaStarts);
+    syllableSpace = saturatingMul(saturatingMul(onsetWays, vowels.size()), codaWays);
+
+    // A word of n syllables can be built syllableSpace^n ways
+    syllableStarts.push_back(0);
+    for (const auto &count : weights.syllables) {
+        uint64_t ways = 1;
+        for (size_t i = 0; i < count.first; i++) {
+            ways = saturatingMul(ways, syllableSpace);
+        }
+        syllableStarts.push_back(saturatingAdd(syllableStarts.back(), ways));
+    }
+    space = syllableStarts.back();
+}
 
 Result<std::wstring> Generator::generate(void) const {
-    std::wstringstream word;
-
-    // Generate a random onset
-    std::uniform_int_distribution<size_t> onsetOptionsDist(0, onsetOptions.size() - 1);
-    const auto onsetOption = onsetOptionsDist(g_rng);
-    for (const auto &cat : onsetOptions[onsetOption]) {
-        if (cat == L"∅") {
-            // No onset
-            break;
+    std::wstring word;
+    const auto res = generate(word);
+    if (res.has_value()) {
+        return res.value();
+    }
+    return word;
+}
+
+std::optional<Error> Generator::generate(std::wstring &out) const {
+    out.clear();
+    out.reserve(maxLength);
+    return append(g_rng, out);
+}
+
+std::optional<Error> Generator::generateAt(
+        const uint64_t seed, const uint64_t k, std::wstring &out) const {
+    Philox rng(seed, k);
+    return generate(rng, out);
+}
+
+// Words generated into one string before they're stitched together
+static constexpr size_t GenerateChunk = 4096;
+
+// Join strings generated in parallel into out. Chunk c made the words
+// [firstWords[c], firstWords[c + 1]), whose out.offsets are still relative to texts[c]
+static void stitch(
+        std::vector<std::wstring> &texts, const std::vector<size_t> &firstWords,
+        WordArena &out, Pool &pool) {
+    const auto chunks = texts.size();
+    std::vector<size_t> starts(chunks + 1, 0);
+    for (size_t chunk = 0; chunk < chunks; chunk++) {
+        starts[chunk + 1] = starts[chunk] + texts[chunk].length();
+    }
+    out.text.resize(starts[chunks]);
+    pool.parallelFor(chunks, 1, [&](const size_t begin, const size_t end, const size_t) {
+        for (size_t chunk = begin; chunk < end; chunk++) {
+            std::copy(texts[chunk].begin(), texts[chunk].end(), out.text.begin() + starts[chunk]);
+            std::wstring().swap(texts[chunk]);
+            for (auto i = firstWords[chunk]; i < firstWords[chunk + 1]; i++) {
+                out.offsets[i + 1] += starts[chunk];
+            }
+        }
+    });
+}
+
+std::optional<Error> Generator::generateInto(
+        const size_t count, WordArena &out, Pool &pool,
+        const std::optional<uint64_t> seed) const {
+    const auto base = seed.has_value()
+        ? seed.value()
+        : (static_cast<uint64_t>(g_rng()) << 32) | g_rng();
+    const auto chunks = (count + GenerateChunk - 1) / GenerateChunk;
+
+    // Every chunk generates into its own string, with offsets relative to it for now
+    std::vector<std::wstring> texts(chunks);
+    std::vector<std::optional<Error>> errors(chunks);
+    out.offsets.resize(count + 1);
+    out.offsets[0] = 0;
+    pool.parallelFor(count, GenerateChunk, [&](
+            const size_t begin, const size_t end, const size_t) {
+        const auto chunk = begin / GenerateChunk;
+        auto &text = texts[chunk];
+        for (size_t i = begin; i < end; i++) {
+            Philox rng(base, i);
+            auto res = append(rng, text);
+            if (res.has_value()) {
+                errors[chunk] = std::move(res);
+                return;
+            }
+            out.offsets[i + 1] = text.length();
         }
-        // Add a sound from every category in the randomly selected onset
-        try {
-            const auto sounds = categories.at(cat);
-            std::uniform_int_distribution<size_t> soundDist(0, sounds.size() - 1);
-            const auto sound = soundDist(g_rng);
-            word << sounds[sound];
-        } catch (std::out_of_range &) {
-            return Error { ErrorType::UnknownCategory, cat };
+    });
+    for (auto &error : errors) {
+        if (error.has_value()) {
+            out.text.clear();
+            out.offsets.clear();
+            return error;
         }
     }
 
-    // Pick a random vowel
-    std::uniform_int_distribution<size_t> vowelDist(0, vowels.size() - 1);
-    const auto vowel = vowelDist(g_rng);
-    word << vowels[vowel];
+    std::vector<size_t> firstWords;
+    for (size_t chunk = 0; chunk <= chunks; chunk++) {
+        firstWords.push_back(std::min(count, chunk * GenerateChunk));
+    }
+    stitch(texts, firstWords, out, pool);
+    return std::nullopt;
+}
+
+Result<WordArena> Generator::generateN(
+        const size_t count, Pool &pool, const std::optional<uint64_t> seed) const {
+    WordArena arena;
+    const auto res = generateInto(count, arena, pool, seed);
+    if (res.has_value()) {
+        return res.value();
+    }
+    return arena;
+}
+
+uint64_t Generator::spaceSize(void) const {
+    return space;
+}
+
+// Spell way number index of building one of the options
+static void spellOption(
+        uint64_t index, const std::vector<uint32_t> &cats, const std::vector<uint32_t> &offsets,
+        const std::vector<uint64_t> &strides, const std::vector<uint64_t> &starts,
+        const std::vector<uint32_t> &categorySounds, const std::wstring &soundPool,
+        const std::vector<uint32_t> &soundOffsets, std::wstring &out) {
+    const auto opt = std::upper_bound(starts.begin(), starts.end(), index) - starts.begin() - 1;
+    index -= starts[opt];
+    for (auto i = offsets[opt]; i < offsets[opt + 1]; i++) {
+        const auto sound = categorySounds[cats[i]] + index / strides[i];
+        index %= strides[i];
+        out.append(
+            soundPool, soundOffsets[sound], soundOffsets[sound + 1] - soundOffsets[sound]
+        );
+    }
+}
+
+void Generator::spell(const uint64_t index, std::wstring &out) const {
+    const auto length = std::upper_bound(syllableStarts.begin(), syllableStarts.end(), index)
+        - syllableStarts.begin() - 1;
+    const auto syllables = weights.syllables[length].first;
+    auto rest = index - syllableStarts[length];
+    uint64_t place = 1;
+    for (size_t i = 1; i < syllables; i++) {
+        place = saturatingMul(place, syllableSpace);
+    }
+    for (size_t i = 0; i < syllables; i++) {
+        spellSyllable(rest / place, out);
+        rest %= place;
+        place /= syllableSpace;
+    }
+}
+
+void Generator::spellSyllable(const uint64_t index, std::wstring &out) const {
+    const auto codaWays = codaStarts.back();
+    const auto coda = index % codaWays;
+    const auto vowel = (index / codaWays) % vowels.size();
+    const auto onset = index / codaWays / vowels.size();
+    spellOption(
+        onset, onsetCategories, onsetOffsets, onsetStrides, onsetStarts,
+        categorySounds, soundPool, soundOffsets, out
+    );
+    const auto sound = categorySounds[vowelCategory] + vowel;
+    out.append(soundPool, soundOffsets[sound], soundOffsets[sound + 1] - soundOffsets[sound]);
+    spellOption(
+        coda, codaCategories, codaOffsets, codaStrides, codaStarts,
+        categorySounds, soundPool, soundOffsets, out
+    );
+}
 
-    // Generate a random coda
-    std::uniform_int_distribution<size_t> codaOptionsDist(0, codaOptions.size() - 1);
-    const auto codaOption = codaOptionsDist(g_rng);
-    for (const auto &cat : codaOptions[codaOption]) {
-        if (cat == L"∅") {
-            // No coda
+// Chance of building one of the options the way with the given index
+static double optionChance(
+        uint64_t index, const std::vector<uint32_t> &cats, const std::vector<uint32_t> &offsets,
+        const std::vector<uint64_t> &strides, const std::vector<uint64_t> &starts,
+        const std::vector<double> &optionChances, const std::vector<uint32_t> &categorySounds,
+        const std::vector<double> &soundChances) {
+    const auto opt = std::upper_bound(starts.begin(), starts.end(), index) - starts.begin() - 1;
+    index -= starts[opt];
+    auto chance = optionChances[opt];
+    for (auto i = offsets[opt]; i < offsets[opt + 1]; i++) {
+        chance *= soundChances[categorySounds[cats[i]] + index / strides[i]];
+        index %= strides[i];
+    }
+    return chance;
+}
+
+double Generator::wayChance(const uint64_t index) const {
+    const auto length = std::upper_bound(syllableStarts.begin(), syllableStarts.end(), index)
+        - syllableStarts.begin() - 1;
+    const auto syllables = weights.syllables[length].first;
+    auto chance = lengthChances[length];
+    auto rest = index - syllableStarts[length];
+    uint64_t place = 1;
+    for (size_t i = 1; i < syllables; i++) {
+        place = saturatingMul(place, syllableSpace);
+    }
+    for (size_t i = 0; i < syllables; i++) {
+        chance *= syllableChance(rest / place);
+        rest %= place;
+        place /= syllableSpace;
+    }
+    return chance;
+}
+
+double Generator::syllableChance(const uint64_t index) const {
+    const auto codaWays = codaStarts.back();
+    const auto coda = index % codaWays;
+    const auto vowel = (index / codaWays) % vowels.size();
+    const auto onset = index / codaWays / vowels.size();
+    return optionChance(
+        onset, onsetCategories, onsetOffsets, onsetStrides, onsetStarts,
+        onsetChances, categorySounds, soundChances
+    ) * soundChances[categorySounds[vowelCategory] + vowel] * optionChance(
+        coda, codaCategories, codaOffsets, codaStrides, codaStarts,
+        codaChances, categorySounds, soundChances
+    );
+}
+
+std::optional<Error> Generator::unrank(const uint64_t index, std::wstring &out) const {
+    if (index >= space) {
+        return Error {
+            ErrorType::OutOfRange,
+            L"Word index " + std::to_wstring(index) + L" is past the end of "
+                + std::to_wstring(space)
+        };
+    }
+    out.clear();
+    spell(index, out);
+    return std::nullopt;
+}
+
+Result<std::wstring> Generator::unrank(const uint64_t index) const {
+    std::wstring word;
+    const auto res = unrank(index, word);
+    if (res.has_value()) {
+        return res.value();
+    }
+    return word;
+}
+
+// Try every way of building word[pos...] from categories [i, end) of an option, in index order.
+// index is the option's index so far, and rest carries on matching after the option
+static bool matchOption(
+        const std::wstring &word, const size_t pos, const std::vector<uint32_t> &cats,
+        const std::vector<uint64_t> &strides, const size_t i, const size_t end,
+        const uint64_t index, const std::vector<uint32_t> &categorySounds,
+        const std::wstring &soundPool, const std::vector<uint32_t> &soundOffsets,
+        const std::function<bool(size_t, uint64_t)> &rest) {
+    if (i == end) {
+        return rest(pos, index);
+    }
+    const auto cat = cats[i];
+    for (auto sound = categorySounds[cat]; sound < categorySounds[cat + 1]; sound++) {
+        const auto len = soundOffsets[sound + 1] - soundOffsets[sound];
+        if (word.compare(pos, len, soundPool, soundOffsets[sound], len) == 0
+                && matchOption(
+                    word, pos + len, cats, strides, i + 1, end,
+                    index + (sound - categorySounds[cat]) * strides[i],
+                    categorySounds, soundPool, soundOffsets, rest
+                )) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Generator::matchSyllable(
+        const std::wstring &word, const size_t pos,
+        const std::function<bool(size_t, uint64_t)> &rest) const {
+    const auto codaWays = codaStarts.back();
+    const auto matchPart = [&](
+            const size_t start, const std::vector<uint32_t> &cats,
+            const std::vector<uint32_t> &offsets, const std::vector<uint64_t> &strides,
+            const std::vector<uint64_t> &starts,
+            const std::function<bool(size_t, uint64_t)> &after) {
+        for (size_t opt = 0; opt + 1 < starts.size(); opt++) {
+            if (starts[opt + 1] != starts[opt] && matchOption(
+                    word, start, cats, strides, offsets[opt], offsets[opt + 1], starts[opt],
+                    categorySounds, soundPool, soundOffsets, after
+                )) {
+                return true;
+            }
+        }
+        return false;
+    };
+    return matchPart(
+        pos, onsetCategories, onsetOffsets, onsetStrides, onsetStarts,
+        [&](const size_t onsetEnd, const uint64_t onset) {
+            for (size_t vowel = 0; vowel < vowels.size(); vowel++) {
+                const auto sound = categorySounds[vowelCategory] + vowel;
+                const auto len = soundOffsets[sound + 1] - soundOffsets[sound];
+                if (word.compare(onsetEnd, len, soundPool, soundOffsets[sound], len) != 0) {
+                    continue;
+                }
+                const auto done = matchPart(
+                    onsetEnd + len, codaCategories, codaOffsets, codaStrides, codaStarts,
+                    [&](const size_t codaEnd, const uint64_t coda) {
+                        return rest(codaEnd, (onset * vowels.size() + vowel) * codaWays + coda);
+                    }
+                );
+                if (done) {
+                    return true;
+                }
+            }
+            return false;
+        }
+    );
+}
+
+Result<uint64_t> Generator::rank(const std::wstring &word) const {
+    // Search in index order, so the first way found has the lowest index.
+    // Whether the rest of the word can be built from a position only depends on how many
+    // syllables are left, so a position that failed once is skipped from then on, by every length
+    uint64_t found = 0;
+    const auto most = weights.syllables.back().first;
+    std::vector<bool> dead((word.length() + 1) * (most + 1), false);
+    std::function<bool(size_t, size_t, uint64_t)> matchFrom = [&](
+            const size_t pos, const size_t left, const uint64_t index) {
+        if (left == 0) {
+            found = index;
+            return pos == word.length();
+        }
+        if (dead[pos * (most + 1) + left]) {
+            return false;
+        }
+        const auto matched = matchSyllable(
+            word, pos, [&](const size_t end, const uint64_t syllable) {
+                return matchFrom(end, left - 1, index * syllableSpace + syllable);
+            }
+        );
+        dead[pos * (most + 1) + left] = !matched;
+        return matched;
+    };
+    for (size_t length = 0; length < weights.syllables.size(); length++) {
+        if (matchFrom(0, weights.syllables[length].first, 0)) {
+            return syllableStarts[length] + found;
+        }
+    }
+    return Error { ErrorType::OutOfRange, L"'" + word + L"' can't be built" };
+}
+
+// Hashes of the words handed out so far, shared by every thread without locks.
+// Only the hash of a word is kept, so a collision can throw away a new word but never let a
+// duplicate through
+struct FingerprintSet {
+    FingerprintSet(const size_t count) {
+        size_t capacity = 16;
+        while (capacity < count * 2) {
+            capacity <<= 1;
+        }
+        mask = capacity - 1;
+        slots.reset(new std::atomic<uint64_t>[capacity]);
+        for (size_t i = 0; i < capacity; i++) {
+            slots[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Add the word, giving back whether it's new. Holds at most count words
+    bool insert(const wchar_t *const word, const size_t len) {
+        auto hash = static_cast<uint64_t>(
+            std::hash<std::wstring_view> {}(std::wstring_view(word, len))
+        );
+        hash |= hash == 0; // 0 marks an empty slot
+        for (auto i = hash & mask; ; i = (i + 1) & mask) {
+            auto seen = slots[i].load(std::memory_order_relaxed);
+            if (seen == 0
+                    && slots[i].compare_exchange_strong(seen, hash, std::memory_order_relaxed)) {
+                return true;
+            }
+            if (seen == hash) {
+                return false;
+            }
+        }
+    }
+
+    uint64_t mask;
+    std::unique_ptr<std::atomic<uint64_t>[]> slots;
+};
+
+// Past this fraction of the space, list every word rather than drawing random ones
+static constexpr uint64_t EnumerateFraction = 4;
+
+// Random draws allowed per word asked for before giving up on sampling
+static constexpr size_t SampleAttempts = 16;
+
+// Largest space that's ever listed out in full. Listing keeps a 16-byte key per way, held
+// twice while the chunks are merged, and then a set of up to 2^23 8-byte word hashes beside
+// one copy of the keys. Either way that peaks at 32 bytes per way, or 128 MiB at this limit
+static constexpr uint64_t EnumerateLimit = 1ull << 22;
+
+std::optional<Error> Generator::generateUniqueInto(
+        const size_t count, WordArena &out, Pool &pool) const {
+    out.text.clear();
+    out.offsets.assign(1, 0);
+    const auto missing = [](
+            const std::vector<uint32_t> &cats, const std::vector<uint32_t> &offsets,
+            const std::vector<std::vector<std::wstring>> &names) -> std::optional<Error> {
+        for (size_t opt = 0; opt + 1 < offsets.size(); opt++) {
+            for (auto i = offsets[opt]; i < offsets[opt + 1]; i++) {
+                if (cats[i] == MissingCategory) {
+                    return Error { ErrorType::UnknownCategory, names[opt][i - offsets[opt]] };
+                }
+            }
+        }
+        return std::nullopt;
+    };
+    auto missingRes = missing(onsetCategories, onsetOffsets, onsetOptions);
+    if (!missingRes.has_value()) {
+        missingRes = missing(codaCategories, codaOffsets, codaOptions);
+    }
+    if (missingRes.has_value()) {
+        return missingRes;
+    }
+    if (count > space) {
+        return Error {
+            ErrorType::OutOfRange,
+            L"Asked for " + std::to_wstring(count) + L" unique words, but only "
+                + std::to_wstring(space) + L" can be built"
+        };
+    }
+    if (count == 0) {
+        return std::nullopt;
+    }
+    const auto listable = space <= EnumerateLimit;
+    if (listable && count > space / EnumerateFraction) {
+        return enumerateUnique(count, out, pool);
+    }
+    if (!sampleUnique(count, out, pool, false)) {
+        return std::nullopt;
+    }
+    if (listable) {
+        return enumerateUnique(count, out, pool);
+    }
+
+    // Too many ways to list, so draw them evenly instead of through the generator.
+    // This gets past a few words soaking up the draws, but not past there being too few words
+    if (!sampleUnique(count, out, pool, true)) {
+        return std::nullopt;
+    }
+    return Error {
+        ErrorType::OutOfRange,
+        L"Couldn't find " + std::to_wstring(count) + L" unique words, and listing all "
+            + std::to_wstring(space) + L" ways to pick from would take too much memory"
+    };
+}
+
+Result<WordArena> Generator::generateUnique(const size_t count, Pool &pool) const {
+    WordArena arena;
+    const auto res = generateUniqueInto(count, arena, pool);
+    if (res.has_value()) {
+        return res.value();
+    }
+    return arena;
+}
+
+bool Generator::sampleUnique(
+        const size_t count, WordArena &out, Pool &pool, const bool evenly) const {
+    // Every worker draws words from its own stream until count new ones have been claimed
+    FingerprintSet seen(count + pool.workers());
+    std::atomic<size_t> claimed(0);
+    std::atomic<size_t> rejected(0);
+    std::atomic<bool> gaveUp(false);
+    const auto streams = pool.workers();
+    const auto base = (static_cast<uint64_t>(g_rng()) << 32) | g_rng();
+    std::vector<std::wstring> texts(streams);
+    std::vector<std::vector<size_t>> ends(streams);
+    pool.parallelFor(streams, 1, [&](const size_t stream, const size_t, const size_t) {
+        Philox rng(base, stream);
+        std::uniform_int_distribution<uint64_t> pick(0, space - 1);
+        auto &text = texts[stream];
+        while (claimed.load(std::memory_order_relaxed) < count && !gaveUp.load()) {
+            const auto start = text.length();
+            if (evenly) {
+                const auto index = pick(rng);
+                if (!(wayChance(index) > 0)) {
+                    if (rejected.fetch_add(1, std::memory_order_relaxed) > count * SampleAttempts) {
+                        gaveUp = true;
+                    }
+                    continue;
+                }
+                spell(index, text);
+            } else {
+                append(rng, text);
+            }
+            if (!seen.insert(text.data() + start, text.length() - start)) {
+                text.resize(start);
+                if (rejected.fetch_add(1, std::memory_order_relaxed) > count * SampleAttempts) {
+                    gaveUp = true;
+                }
+                continue;
+            }
+            if (claimed.fetch_add(1) >= count) {
+                text.resize(start);
+                break;
+            }
+            ends[stream].push_back(text.length());
+        }
+    });
+    if (gaveUp) {
+        return true;
+    }
+
+    std::vector<size_t> firstWords(1, 0);
+    for (const auto &streamEnds : ends) {
+        firstWords.push_back(firstWords.back() + streamEnds.size());
+    }
+    out.offsets.resize(count + 1);
+    for (size_t stream = 0; stream < streams; stream++) {
+        std::copy(
+            ends[stream].begin(), ends[stream].end(), out.offsets.begin() + firstWords[stream] + 1
+        );
+    }
+    stitch(texts, firstWords, out, pool);
+    return false;
+}
+
+std::optional<Error> Generator::enumerateUnique(
+        const size_t count, WordArena &out, Pool &pool) const {
+    // Give every way the key log(u) / chance for a random u, leaving out ways that can't be
+    // generated. Taking ways from the largest key down is a weighted draw without repeats
+    // (Efraimidis and Spirakis), and skipping words already taken makes it one over words
+    const auto base = (static_cast<uint64_t>(g_rng()) << 32) | g_rng();
+    const auto chunks = (space + GenerateChunk - 1) / GenerateChunk;
+    std::vector<std::vector<std::pair<double, uint64_t>>> chunkKeys(chunks);
+    pool.parallelFor(space, GenerateChunk, [&](const size_t begin, const size_t end, const size_t) {
+        auto &keys = chunkKeys[begin / GenerateChunk];
+        keys.reserve(end - begin);
+        for (auto i = begin; i < end; i++) {
+            const auto chance = wayChance(i);
+            if (chance > 0) {
+                Philox rng(base, i);
+                keys.push_back({ std::log((rng() + 0.5) / 4294967296.0) / chance, i });
+            }
+        }
+    });
+    size_t total = 0;
+    for (const auto &chunk : chunkKeys) {
+        total += chunk.size();
+    }
+    std::vector<std::pair<double, uint64_t>> keys;
+    keys.reserve(total);
+    for (auto &chunk : chunkKeys) {
+        keys.insert(keys.end(), chunk.begin(), chunk.end());
+        std::vector<std::pair<double, uint64_t>>().swap(chunk);
+    }
+    std::sort(keys.begin(), keys.end(), std::greater<std::pair<double, uint64_t>>());
+
+    FingerprintSet seen(count);
+    out.offsets.resize(1);
+    std::wstring word;
+    for (const auto &key : keys) {
+        if (out.size() == count) {
             break;
         }
-        // Add a sound from every category in the randomly selected onset
-        try {
-            const auto sounds = categories.at(cat);
-            std::uniform_int_distribution<size_t> soundDist(0, sounds.size() - 1);
-            const auto sound = soundDist(g_rng);
-            word << sounds[sound];
-        } catch (std::out_of_range &) {
-            return Error { ErrorType::UnknownCategory, cat };
+        word.clear();
+        spell(key.second, word);
+        if (seen.insert(word.data(), word.length())) {
+            out.text += word;
+            out.offsets.push_back(out.text.length());
         }
     }
+    if (out.size() < count) {
+        const auto found = out.size();
+        out.text.clear();
+        out.offsets.assign(1, 0);
+        return Error {
+            ErrorType::OutOfRange,
+            L"Asked for " + std::to_wstring(count) + L" unique words, but only "
+                + std::to_wstring(found) + L" different ones can be generated"
+        };
+    }
+    return std::nullopt;
+}
+
+size_t WordArena::size(void) const {
+    return offsets.empty() ? 0 : offsets.size() - 1;
+}
 
-    return word.str();
+std::wstring_view WordArena::word(const size_t i) const {
+    return std::wstring_view(text).substr(offsets[i], offsets[i + 1] - offsets[i]);
 }
 
 std::optional<Error> Generator::toFile(const char *const fileName) const {
@@ -293,39 +1118,212 @@ std::optional<Error> Generator::toFile(const char *const fileName) const {
         };
     }
 
+    // Weights of 1 are left out, so unweighted settings are written the same as ever
+    const auto weight = [](const double w) {
+        return w == 1 ? std::wstring() : L":" + formatWeight(w);
+    };
+
     for (const auto &cat : categories) {
         file << cat.first << L" { ";
-        for (const auto &sound : cat.second) {
-            file << sound << L" ";
+        const auto &soundWeights = weights.sounds.at(cat.first);
+        for (size_t i = 0; i < cat.second.size(); i++) {
+            file << cat.second[i] << weight(soundWeights[i]) << L" ";
         }
         file << L"}\n";
     }
 
     file << L"#\n";
 
-    for (const auto &vowel : vowels) {
-        file << vowel << "\n";
+    for (size_t i = 0; i < vowels.size(); i++) {
+        file << vowels[i] << weight(weights.vowels[i]) << "\n";
     }
     
     file << L"#\n";
 
-    for (const auto &opt : onsetOptions) {
-        for (const auto &cat : opt) {
+    for (size_t i = 0; i < onsetOptions.size(); i++) {
+        for (const auto &cat : onsetOptions[i]) {
             file << cat << L" ";
         }
+        if (weights.onsets[i] != 1) {
+            file << weight(weights.onsets[i]) << L" ";
+        }
         file << L'\n';
     }
     
     file << L"#\n";
 
-    for (const auto &opt : codaOptions) {
-        for (const auto &cat : opt) {
+    for (size_t i = 0; i < codaOptions.size(); i++) {
+        for (const auto &cat : codaOptions[i]) {
             file << cat << L" ";
         }
+        if (weights.codas[i] != 1) {
+            file << weight(weights.codas[i]) << L" ";
+        }
         file << L'\n';
     }
 
+    // Only words of exactly one syllable don't need the section at all
+    if (weights.syllables.size() != 1 || weights.syllables[0].first != 1) {
+        file << L"#\n";
+        for (const auto &count : weights.syllables) {
+            file << count.first << weight(count.second) << L'\n';
+        }
+    }
+
     file.close();
     return std::nullopt;
 }
 
+std::vector<std::wstring> Generator::inventory(void) const {
+    std::vector<std::wstring> sounds;
+    const auto add = [&sounds](const std::wstring &sound) {
+        if (std::find(sounds.begin(), sounds.end(), sound) == sounds.end()) {
+            sounds.push_back(sound);
+        }
+    };
+    for (const auto &cat : categories) {
+        for (const auto &sound : cat.second) {
+            add(sound);
+        }
+    }
+    for (const auto &vowel : vowels) {
+        add(vowel);
+    }
+    return sounds;
+}
+
+// Point part at the index-th way of building one of its options
+static void seekPart(
+        WordIterator::Part &part, uint64_t index, const std::vector<uint32_t> &offsets,
+        const std::vector<uint64_t> &strides, const std::vector<uint64_t> &starts) {
+    part.option = std::upper_bound(starts.begin(), starts.end(), index) - starts.begin() - 1;
+    index -= starts[part.option];
+    part.digits.clear();
+    for (auto i = offsets[part.option]; i < offsets[part.option + 1]; i++) {
+        part.digits.push_back(index / strides[i]);
+        index %= strides[i];
+    }
+}
+
+// Count part up by one, giving back true if it wrapped around to the start
+static bool advancePart(
+        WordIterator::Part &part, const std::vector<uint32_t> &cats,
+        const std::vector<uint32_t> &offsets, const std::vector<uint64_t> &starts,
+        const std::vector<uint32_t> &categorySounds) {
+    for (auto k = part.digits.size(); k-- > 0;) {
+        const auto cat = cats[offsets[part.option] + k];
+        if (++part.digits[k] < categorySounds[cat + 1] - categorySounds[cat]) {
+            return false;
+        }
+        part.digits[k] = 0;
+    }
+
+    // Move on to the next option that builds anything
+    const auto options = starts.size() - 1;
+    auto wrapped = false;
+    do {
+        part.option++;
+        if (part.option == options) {
+            part.option = 0;
+            wrapped = true;
+        }
+    } while (starts[part.option + 1] == starts[part.option]);
+    part.digits.assign(offsets[part.option + 1] - offsets[part.option], 0);
+    return wrapped;
+}
+
+static void appendPart(
+        const WordIterator::Part &part, const std::vector<uint32_t> &cats,
+        const std::vector<uint32_t> &offsets, const Generator &gen, std::wstring &out) {
+    for (size_t k = 0; k < part.digits.size(); k++) {
+        const auto sound = gen.categorySounds[cats[offsets[part.option] + k]] + part.digits[k];
+        out.append(
+            gen.soundPool, gen.soundOffsets[sound],
+            gen.soundOffsets[sound + 1] - gen.soundOffsets[sound]
+        );
+    }
+}
+
+// Point syllable at the one with the given index
+static void seekSyllable(
+        WordIterator::Syllable &syllable, const uint64_t index, const Generator &gen) {
+    const auto codaWays = gen.codaStarts.back();
+    seekPart(
+        syllable.onset, index / codaWays / gen.vowels.size(),
+        gen.onsetOffsets, gen.onsetStrides, gen.onsetStarts
+    );
+    syllable.vowel = (index / codaWays) % gen.vowels.size();
+    seekPart(syllable.coda, index % codaWays, gen.codaOffsets, gen.codaStrides, gen.codaStarts);
+}
+
+// Count syllable up by one, giving back true if it wrapped around to the start
+static bool advanceSyllable(WordIterator::Syllable &syllable, const Generator &gen) {
+    if (!advancePart(
+            syllable.coda, gen.codaCategories, gen.codaOffsets, gen.codaStarts, gen.categorySounds
+        )
+            || ++syllable.vowel < gen.vowels.size()) {
+        return false;
+    }
+    syllable.vowel = 0;
+    return advancePart(
+        syllable.onset, gen.onsetCategories, gen.onsetOffsets, gen.onsetStarts, gen.categorySounds
+    );
+}
+
+WordIterator::WordIterator(const Generator &gen, const uint64_t begin, const uint64_t end):
+        gen(gen), position(begin), last(std::min(end, gen.spaceSize())), length(0) {
+    if (position >= last) {
+        return;
+    }
+    length = std::upper_bound(gen.syllableStarts.begin(), gen.syllableStarts.end(), begin)
+        - gen.syllableStarts.begin() - 1;
+    syllables.resize(gen.weights.syllables[length].first);
+    auto rest = begin - gen.syllableStarts[length];
+    uint64_t place = 1;
+    for (size_t i = 1; i < syllables.size(); i++) {
+        place = saturatingMul(place, gen.syllableSpace);
+    }
+    for (auto &syllable : syllables) {
+        seekSyllable(syllable, rest / place, gen);
+        rest %= place;
+        place /= gen.syllableSpace;
+    }
+}
+
+bool WordIterator::next(std::wstring &out) {
+    if (position >= last) {
+        return false;
+    }
+    out.clear();
+    for (const auto &syllable : syllables) {
+        appendPart(syllable.onset, gen.onsetCategories, gen.onsetOffsets, gen, out);
+        const auto sound = gen.categorySounds[gen.vowelCategory] + syllable.vowel;
+        out.append(
+            gen.soundPool, gen.soundOffsets[sound],
+            gen.soundOffsets[sound + 1] - gen.soundOffsets[sound]
+        );
+        appendPart(syllable.coda, gen.codaCategories, gen.codaOffsets, gen, out);
+    }
+
+    position++;
+    if (position >= last) {
+        return true;
+    }
+
+    // Count up from the last syllable, moving on to longer words once every syllable wraps
+    auto carry = true;
+    for (auto i = syllables.size(); carry && i-- > 0;) {
+        carry = advanceSyllable(syllables[i], gen);
+    }
+    if (carry) {
+        length++;
+        Syllable first;
+        seekSyllable(first, 0, gen);
+        syllables.assign(gen.weights.syllables[length].first, first);
+    }
+    return true;
+}
+
+uint64_t WordIterator::index(void) const {
+    return position;
+}
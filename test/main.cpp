@@ -1,19 +1,66 @@
 // Examples of how to use the library
 
 #include <variant>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
 #include <vector>
+#include <chrono>
+#include <thread>
 #include <iostream>
 #include <err.hpp>
 #include <natevolve.hpp>
 #include <sndwrp.hpp>
+#include <transducer.hpp>
+#include <session.hpp>
+#include <changecache.hpp>
+#include <reconstruct.hpp>
 #include <romanizer.hpp>
+#include <staticromanizer.hpp>
 #include <wordup.hpp>
+#include <pool.hpp>
+#include <philox.hpp>
+#include <pipeline.hpp>
+#include <simd.hpp>
+#include "test-romanization.rmz.hpp"
+
+static const std::vector<std::wstring> g_testWords({
+    L"fak",
+    L"faki",
+    L"alphat",
+    L"fat",
+    L"pxm",
+    L"ad͡ʒi",
+    L"adi"
+});
 
 void printChanges(const std::vector<natevolve::sndwrp::SoundChange> &changes);
 bool testApply(const std::vector<natevolve::sndwrp::SoundChange> &changes);
-void testRomanize(const natevolve::romanizer::Romanizer &romanizer);
+bool testCompiledApply(const std::vector<natevolve::sndwrp::SoundChange> &changes);
+bool testLexiconApply(const std::vector<natevolve::sndwrp::SoundChange> &changes);
+bool benchScan(const std::vector<natevolve::sndwrp::SoundChange> &changes);
+bool testSession(const std::vector<natevolve::sndwrp::SoundChange> &changes);
+bool testCache(const std::vector<natevolve::sndwrp::SoundChange> &changes);
+bool testTrace(const std::vector<natevolve::sndwrp::SoundChange> &changes);
+bool testParseErrors(void);
+bool testReconstruct(
+    const std::vector<natevolve::sndwrp::SoundChange> &changes,
+    const natevolve::wordup::Generator &gen
+);
+bool testRomanize(const natevolve::romanizer::Romanizer &romanizer);
+bool testRomanizeCorpus(const natevolve::romanizer::Romanizer &romanizer);
 void printGenData(const natevolve::wordup::Generator &gen);
 void testWordGeneration(const natevolve::wordup::Generator &gen);
+bool testCompiledGeneration(const natevolve::wordup::Generator &gen);
+bool testBulkGeneration(const natevolve::wordup::Generator &gen);
+bool testReproducibleGeneration(const natevolve::wordup::Generator &gen);
+bool testUniqueGeneration(const natevolve::wordup::Generator &gen);
+bool testWordSpace(const natevolve::wordup::Generator &gen);
+bool testWeightedGeneration(void);
+bool testPipeline(
+    const std::vector<natevolve::sndwrp::SoundChange> &changes,
+    const natevolve::romanizer::Romanizer &romanizer, const natevolve::wordup::Generator &gen
+);
 
 int main(int argc, char **argv) {
     natevolve::enableUtf8();
@@ -47,9 +94,59 @@ int main(int argc, char **argv) {
     if (!testApply(natevolve::ok(changes))) {
         return 1;
     }
-    testRomanize(natevolve::ok(romanizer));
+    if (!testCompiledApply(natevolve::ok(changes))) {
+        return 1;
+    }
+    if (!testLexiconApply(natevolve::ok(changes))) {
+        return 1;
+    }
+    if (!benchScan(natevolve::ok(changes))) {
+        return 1;
+    }
+    if (!testSession(natevolve::ok(changes))) {
+        return 1;
+    }
+    if (!testCache(natevolve::ok(changes))) {
+        return 1;
+    }
+    if (!testTrace(natevolve::ok(changes))) {
+        return 1;
+    }
+    if (!testParseErrors()) {
+        return 1;
+    }
+    if (!testReconstruct(natevolve::ok(changes), natevolve::ok(wordgen))) {
+        return 1;
+    }
+    if (!testRomanize(natevolve::ok(romanizer))) {
+        return 1;
+    }
+    if (!testRomanizeCorpus(natevolve::ok(romanizer))) {
+        return 1;
+    }
     printGenData(natevolve::ok(wordgen));
     testWordGeneration(natevolve::ok(wordgen));
+    if (!testCompiledGeneration(natevolve::ok(wordgen))) {
+        return 1;
+    }
+    if (!testBulkGeneration(natevolve::ok(wordgen))) {
+        return 1;
+    }
+    if (!testReproducibleGeneration(natevolve::ok(wordgen))) {
+        return 1;
+    }
+    if (!testUniqueGeneration(natevolve::ok(wordgen))) {
+        return 1;
+    }
+    if (!testWordSpace(natevolve::ok(wordgen))) {
+        return 1;
+    }
+    if (!testWeightedGeneration()) {
+        return 1;
+    }
+    if (!testPipeline(natevolve::ok(changes), natevolve::ok(romanizer), natevolve::ok(wordgen))) {
+        return 1;
+    }
 
     const auto saveRes = natevolve::ok(wordgen).toFile("test/test-wordgen2.wu");
     if (saveRes.has_value()) {
@@ -82,15 +179,7 @@ void printChanges(const std::vector<natevolve::sndwrp::SoundChange> &changes) {
 }
 
 bool testApply(const std::vector<natevolve::sndwrp::SoundChange> &changes) {
-    const auto words = std::vector<std::wstring>({
-        L"fak",
-        L"faki",
-        L"alphat",
-        L"fat",
-        L"pxm"
-    });
-
-    for (const auto &word : words) {
+    for (const auto &word : g_testWords) {
         std::wcout << L"Applying changes to '" << word << "'" << std::endl;
         auto changedWord = word;
         for (size_t i = 0; i < changes.size(); i++) {
@@ -126,7 +215,419 @@ bool testApply(const std::vector<natevolve::sndwrp::SoundChange> &changes) {
     return true;
 }
 
-void testRomanize(const natevolve::romanizer::Romanizer &romanizer) {
+bool testCompiledApply(const std::vector<natevolve::sndwrp::SoundChange> &changes) {
+    const natevolve::sndwrp::Cascade cascade(changes);
+    natevolve::sndwrp::Transducer transducer(changes);
+    for (const auto &word : g_testWords) {
+        const auto expected = natevolve::sndwrp::applyAllChanges(word, changes);
+        const auto received = natevolve::sndwrp::applyAllChanges(word, cascade);
+        const auto composed = transducer.apply(word);
+        if (natevolve::isErr(expected) || natevolve::isErr(received)
+                || natevolve::ok(expected) != natevolve::ok(received)) {
+            std::wcout << L"Compiled cascade disagrees on '" << word << L"'" << std::endl;
+            return false;
+        }
+        if (natevolve::isErr(composed) || natevolve::ok(expected) != natevolve::ok(composed)) {
+            std::wcout << L"Transducer disagrees on '" << word << L"'" << std::endl;
+            return false;
+        }
+    }
+
+    // Buffers are reused across words
+    std::wstring out;
+    std::wstring scratch;
+    natevolve::sndwrp::Workspace workspace;
+    for (const auto &word : g_testWords) {
+        const auto expected = natevolve::ok(natevolve::sndwrp::applyAllChanges(word, changes));
+        if (natevolve::sndwrp::applyAllChanges(word, changes, out, scratch).has_value()
+                || out != expected) {
+            std::wcout << L"Buffered cascade disagrees on '" << word << L"'" << std::endl;
+            return false;
+        }
+        if (natevolve::sndwrp::applyAllChanges(word, cascade, out, workspace).has_value()
+                || out != expected) {
+            std::wcout << L"Buffered compiled cascade disagrees on '" << word << L"'" << std::endl;
+            return false;
+        }
+    }
+    std::wcout
+        << L"Compiled cascade and transducer match for " << g_testWords.size() << L" words"
+        << std::endl;
+    return true;
+}
+
+bool testLexiconApply(const std::vector<natevolve::sndwrp::SoundChange> &changes) {
+    // Repeat the test words enough times to be split across several tasks
+    std::vector<std::wstring> lexicon;
+    for (size_t i = 0; i < 1000; i++) {
+        lexicon.push_back(g_testWords[i % g_testWords.size()]);
+    }
+
+    natevolve::Pool pool;
+    const auto results = natevolve::sndwrp::applyToLexicon(lexicon, changes, pool);
+    for (size_t i = 0; i < lexicon.size(); i++) {
+        const auto expected = natevolve::sndwrp::applyAllChanges(lexicon[i], changes);
+        if (natevolve::isErr(results[i])
+                || natevolve::ok(results[i]) != natevolve::ok(expected)) {
+            std::wcout << L"Lexicon result " << i << L" is out of order or wrong" << std::endl;
+            return false;
+        }
+    }
+
+    // A worker of one pool calling into a smaller one has to get the smaller one's indices
+    natevolve::Pool big(4);
+    natevolve::Pool small(1);
+    std::mutex smallLock;
+    std::atomic<bool> inRange(true);
+    big.parallelFor(64, 1, [&](size_t, size_t, size_t) {
+        // Give the workers time to pick up tasks, rather than the caller doing them all
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        std::lock_guard<std::mutex> guard(smallLock);
+        small.parallelFor(4, 1, [&](size_t, size_t, size_t worker) {
+            if (worker >= small.workers()) {
+                inRange = false;
+            }
+        });
+    });
+    if (!inRange) {
+        std::wcout << L"A nested pool was handed another pool's worker index" << std::endl;
+        return false;
+    }
+
+    std::wcout << L"Evolved a lexicon of " << lexicon.size() << L" words in order" << std::endl;
+    return true;
+}
+
+// Whether [start, end) of word is one of the sounds in cond
+static bool soundIn(
+        const std::vector<std::wstring> &cond, const std::wstring &word,
+        const size_t start, const size_t end) {
+    return std::any_of(cond.begin(), cond.end(), [&](const std::wstring &sound) {
+        return sound.length() == end - start && word.compare(start, end - start, sound) == 0;
+    });
+}
+
+// How SoundChange::apply worked before it jumped between targets: visit every sound in turn
+// and check it against the target and both conditions
+static void applyPerSound(
+        const natevolve::sndwrp::SoundChange &change, const std::wstring &word,
+        std::wstring &out) {
+    out.clear();
+    const auto len = word.length();
+    const auto boundary = [](const std::vector<std::wstring> &cond) {
+        return std::count(cond.begin(), cond.end(), L"#") > 0;
+    };
+    size_t prev = 0;
+    for (size_t i = 0; i < len; ) {
+        const auto end = natevolve::segmentEnd(word.data(), len, i);
+        const bool correctSound =
+            !change.a.empty() && end - i == change.a.length()
+                && word.compare(i, change.a.length(), change.a) == 0;
+        const bool frontCondFulfilled = correctSound && (
+            (i == 0 && boundary(change.frntCond))
+                || (i > 0 && soundIn(change.frntCond, word, prev, i))
+                || change.frntCond.empty()
+        );
+        const bool endCondFulfilled = frontCondFulfilled && (
+            (end == len && boundary(change.endCond))
+                || (
+                    end < len && soundIn(
+                        change.endCond, word, end, natevolve::segmentEnd(word.data(), len, end)
+                    )
+                ) || change.endCond.empty()
+        );
+        if (endCondFulfilled) {
+            out.append(change.b);
+        } else {
+            out.append(word, i, end - i);
+        }
+        prev = i;
+        i = end;
+    }
+}
+
+// Every vector kernel the CPU has has to agree with the scalar one, including on the tails
+// left over after the last full vector
+static bool testKernels(void) {
+    const auto &kernels = natevolve::simd::supportedKernels();
+    const auto &scalar = kernels.back();
+    for (const auto &kernel : kernels) {
+        for (size_t len = 0; len <= 40; len++) {
+            std::vector<uint32_t> wide(len, 7);
+            std::vector<uint16_t> narrow(len, 7);
+            std::string bytes(len, 'a');
+
+            // Put the value in at every position in turn, and once nowhere
+            for (size_t at = 0; at <= len; at++) {
+                if (at < len) {
+                    wide[at] = 0x10041;
+                    narrow[at] = 0x8041;
+                    bytes[at] = '\xc3';
+                }
+                for (size_t from = 0; from <= len; from++) {
+                    if (kernel.find32(wide.data(), len, from, 0x10041)
+                                != scalar.find32(wide.data(), len, from, 0x10041)
+                            || kernel.find16(narrow.data(), len, from, 0x8041)
+                                != scalar.find16(narrow.data(), len, from, 0x8041)
+                            || kernel.nonAscii(bytes.data(), len, from)
+                                != scalar.nonAscii(bytes.data(), len, from)) {
+                        std::wcout
+                            << L"The " << kernel.name << L" kernel disagrees with the scalar one"
+                            << L" on " << len << L" units from " << from << std::endl;
+                        return false;
+                    }
+                }
+                if (at < len) {
+                    wide[at] = 7;
+                    narrow[at] = 7;
+                    bytes[at] = 'a';
+                }
+            }
+        }
+    }
+
+    std::wcout << L"Checked " << kernels.size() << L" sets of search kernels" << std::endl;
+    return true;
+}
+
+bool benchScan(const std::vector<natevolve::sndwrp::SoundChange> &changes) {
+    if (!testKernels()) {
+        return false;
+    }
+
+    // A long running text, like a whole document evolved at once
+    std::wstring text;
+    while (text.length() < 1000000) {
+        for (const auto &word : g_testWords) {
+            text += word;
+            text += L' ';
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto expected = text;
+    std::wstring next;
+    for (const auto &change : changes) {
+        applyPerSound(change, expected, next);
+        std::swap(expected, next);
+    }
+    const auto perCharacter = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    std::wstring out;
+    std::wstring scratch;
+    natevolve::sndwrp::applyAllChanges(text, changes, out, scratch);
+    const auto scanned = std::chrono::steady_clock::now() - start;
+
+    std::wcout
+        << L"Scanning " << text.length() << L" characters ("
+        << natevolve::simd::kernelName() << L"): per sound "
+        << std::chrono::duration_cast<std::chrono::microseconds>(perCharacter).count()
+        << L"us, vectorized "
+        << std::chrono::duration_cast<std::chrono::microseconds>(scanned).count()
+        << L"us" << std::endl;
+    if (out != expected) {
+        std::wcout << L"Vectorized scan disagrees with per sound loop" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool testSession(const std::vector<natevolve::sndwrp::SoundChange> &changes) {
+    // Snapshot after every change
+    auto session = natevolve::sndwrp::Session::create(g_testWords, changes, 1 << 20);
+    if (natevolve::isErr(session)) {
+        std::wcout
+            << L"Error starting session: " << natevolve::err(session).message << std::endl;
+        return false;
+    }
+
+    // Edit f > v to f > b
+    const natevolve::sndwrp::SoundChange edit(L"f", L"b", { L"#" }, {});
+    const auto changed = std::get<natevolve::sndwrp::Session>(session).setChange(0, edit);
+    if (natevolve::isErr(changed)) {
+        std::wcout << L"Error editing change: " << natevolve::err(changed).message << std::endl;
+        return false;
+    }
+
+    const auto &edited = std::get<natevolve::sndwrp::Session>(session);
+    for (size_t i = 0; i < g_testWords.size(); i++) {
+        const auto expected = natevolve::sndwrp::applyAllChanges(g_testWords[i], edited.changes);
+        if (natevolve::isErr(expected) || natevolve::ok(expected) != edited.evolved[i]) {
+            std::wcout << L"Session disagrees on '" << g_testWords[i] << L"'" << std::endl;
+            return false;
+        }
+    }
+    std::wcout
+        << L"Editing a change re-evolved " << natevolve::ok(changed) << L" words" << std::endl;
+    return true;
+}
+
+bool testCache(const std::vector<natevolve::sndwrp::SoundChange> &changes) {
+    // Small enough that the lexicon below has to evict
+    natevolve::sndwrp::ChangeCache cache(64, 4);
+    std::vector<std::wstring> lexicon;
+    for (size_t i = 0; i < 1000; i++) {
+        lexicon.push_back(g_testWords[i % g_testWords.size()] + std::to_wstring(i % 10));
+    }
+
+    natevolve::Pool pool(4);
+    std::atomic<bool> agreed(true);
+    const auto check = [&](const std::vector<natevolve::sndwrp::SoundChange> &current) {
+        pool.parallelFor(lexicon.size(), 16, [&](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; i++) {
+                const auto cached = cache.apply(lexicon[i], current);
+                const auto expected = natevolve::sndwrp::applyAllChanges(lexicon[i], current);
+                if (natevolve::isErr(cached) || natevolve::ok(cached) != natevolve::ok(expected)) {
+                    agreed = false;
+                }
+            }
+        });
+    };
+    check(changes);
+
+    // Editing the changes has to drop the old results
+    std::vector<natevolve::sndwrp::SoundChange> edited;
+    edited.push_back(natevolve::sndwrp::SoundChange(L"a", L"o", {}, {}));
+    for (const auto &change : changes) {
+        edited.push_back(change);
+    }
+    check(edited);
+
+    if (!agreed) {
+        std::wcout << L"Cached results disagree with applyAllChanges" << std::endl;
+        return false;
+    }
+    std::wcout
+        << L"Change cache: " << cache.hitCount() << L" hits, "
+        << cache.missCount() << L" misses" << std::endl;
+    return cache.hitCount() > 0;
+}
+
+bool testTrace(const std::vector<natevolve::sndwrp::SoundChange> &changes) {
+    const natevolve::sndwrp::Cascade cascade(changes);
+    natevolve::sndwrp::Workspace workspace;
+    natevolve::sndwrp::Trace trace;
+    std::wstring out;
+    for (const auto &word : g_testWords) {
+        cascade.apply(word, out, workspace, &trace);
+
+        // Every change that altered the word has to be in the trace
+        auto changedWord = word;
+        for (size_t i = 0; i < changes.size(); i++) {
+            const auto next = natevolve::ok(changes[i].apply(changedWord));
+            if ((next != changedWord) != trace.hasFired(i)) {
+                std::wcout << L"Trace of '" << word << L"' is wrong for change " << i << std::endl;
+                return false;
+            }
+            changedWord = next;
+        }
+
+        std::wcout << L"Derivation of '" << word << L"':";
+        const auto forms = cascade.derivation(
+            word, trace.steps.data(), trace.steps.data() + trace.steps.size()
+        );
+        for (const auto &form : forms) {
+            std::wcout << L" " << form.first << L". /" << form.second << L"/";
+        }
+        std::wcout << std::endl;
+        if (!forms.empty() && forms.back().second != out) {
+            std::wcout << L"Derivation of '" << word << L"' doesn't end in the result" << std::endl;
+            return false;
+        }
+    }
+
+    // A batch has to trace exactly what one word at a time does
+    std::vector<std::wstring> lexicon;
+    for (size_t i = 0; i < 1000; i++) {
+        lexicon.push_back(g_testWords[i % g_testWords.size()]);
+    }
+    natevolve::Pool pool(4);
+    natevolve::sndwrp::TraceArena traces;
+    natevolve::sndwrp::applyToLexicon(lexicon.data(), lexicon.size(), cascade, pool, traces);
+    for (size_t w = 0; w < lexicon.size(); w++) {
+        cascade.apply(lexicon[w], out, workspace, &trace);
+        const auto count = static_cast<size_t>(traces.stepsEnd(w) - traces.stepsBegin(w));
+        bool same = count == trace.steps.size();
+        for (size_t i = 0; same && i < count; i++) {
+            same = traces.stepsBegin(w)[i].change == trace.steps[i].change
+                && traces.stepsBegin(w)[i].position == trace.steps[i].position;
+        }
+        for (size_t i = 0; same && i < changes.size(); i++) {
+            same = traces.hasFired(w, i) == trace.hasFired(i);
+        }
+        if (!same) {
+            std::wcout << L"Batch trace disagrees on word " << w << std::endl;
+            return false;
+        }
+    }
+    std::wcout << L"Traced " << traces.size() << L" words in a batch" << std::endl;
+    return true;
+}
+
+bool testParseErrors(void) {
+    // Four broken lines around two good ones
+    std::vector<natevolve::Error> errors;
+    const auto changes = natevolve::sndwrp::SoundChange::fromFile(
+        "test/test-bad-changes.sw", errors
+    );
+    for (const auto &error : errors) {
+        std::wcout << L"Diagnostic: " << error.message << std::endl;
+    }
+    if (changes.size() != 2 || errors.size() != 4) {
+        std::wcout
+            << L"Expected 2 changes and 4 errors, got " << changes.size() << L" and "
+            << errors.size() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool testReconstruct(
+        const std::vector<natevolve::sndwrp::SoundChange> &changes,
+        const natevolve::wordup::Generator &gen) {
+    natevolve::sndwrp::Reconstructor anyProto(changes);
+    natevolve::sndwrp::Reconstructor genProto(changes, gen.inventory());
+    std::wstring ancestor;
+    for (const auto &word : g_testWords) {
+        const auto evolved = natevolve::ok(natevolve::sndwrp::applyAllChanges(word, changes));
+
+        // The word itself has to be found, and every ancestor has to evolve the same way
+        anyProto.start(evolved);
+        bool foundWord = false;
+        size_t count = 0;
+        while (anyProto.next(ancestor)) {
+            foundWord = foundWord || ancestor == word;
+            count++;
+            if (natevolve::ok(natevolve::sndwrp::applyAllChanges(ancestor, changes)) != evolved) {
+                std::wcout
+                    << L"Reconstructed '" << ancestor << L"' doesn't evolve into '" << evolved
+                    << L"'" << std::endl;
+                return false;
+            }
+        }
+        if (!foundWord) {
+            std::wcout << L"'" << word << L"' wasn't reconstructed from '" << evolved << L"'";
+            std::wcout << std::endl;
+            return false;
+        }
+
+        std::wcout << L"Ancestors of '" << evolved << L"' from the Wordup inventory:";
+        genProto.start(evolved);
+        size_t genCount = 0;
+        while (genProto.next(ancestor)) {
+            std::wcout << L" " << ancestor;
+            genCount++;
+        }
+        std::wcout << L" (" << genCount << L" of " << count << L")" << std::endl;
+        if (genCount > count) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool testRomanize(const natevolve::romanizer::Romanizer &romanizer) {
     const std::wstring ipaTestWord = L"ʃæθɑih";
     const std::wstring romTestWord = L"shathoihéllo";
 
@@ -139,6 +640,75 @@ void testRomanize(const natevolve::romanizer::Romanizer &romanizer) {
         << L"'. Received: '" << genIpaWord << "'" << std::endl
         << L"Success? "
         << ((genRomWord == romTestWord) && (genIpaWord == ipaTestWord)) << std::endl;
+
+    // <sh> has to win over <s> followed by <h>
+    const natevolve::romanizer::Romanizer digraphs(
+        { { L'ʃ', L"sh" }, { L's', L"s" }, { L'h', L"h" } },
+        { { L"sh", L'ʃ' }, { L"s", L's' }, { L"h", L'h' } }
+    );
+    const auto longest = digraphs.unromanize(L"shsh");
+    std::wcout
+        << L"Unromanizing 'shsh'. Expected: 'ʃʃ'. Received: '" << longest << L"'" << std::endl
+        << L"Success? " << (longest == L"ʃʃ") << std::endl;
+
+    // UTF-8 text has to come out the same as going through wide strings
+    bool utf8Matches = true;
+    for (const auto &word : { ipaTestWord, romTestWord, std::wstring(L"plain ascii θ text ʃ") }) {
+        std::string romUtf8;
+        std::string ipaUtf8;
+        romanizer.romanize(natevolve::fromWstr(word), romUtf8);
+        romanizer.unromanize(natevolve::fromWstr(word), ipaUtf8);
+        utf8Matches = utf8Matches
+            && romUtf8 == natevolve::fromWstr(romanizer.romanize(word))
+            && ipaUtf8 == natevolve::fromWstr(romanizer.unromanize(word));
+    }
+    std::wcout << L"UTF-8 romanization matches? " << utf8Matches << std::endl;
+
+    // The table compiled in from the same .rmz file has to agree with the loaded one
+    const natevolve::romanizer::TestRomanizationRomanizer compiled;
+    bool compiledMatches = true;
+    for (const auto &word : { ipaTestWord, romTestWord, std::wstring(L"plain ascii θ text ʃ") }) {
+        std::string romUtf8;
+        std::string ipaUtf8;
+        compiled.romanize(natevolve::fromWstr(word), romUtf8);
+        compiled.unromanize(natevolve::fromWstr(word), ipaUtf8);
+        compiledMatches = compiledMatches
+            && compiled.romanize(word) == romanizer.romanize(word)
+            && compiled.unromanize(word) == romanizer.unromanize(word)
+            && romUtf8 == natevolve::fromWstr(romanizer.romanize(word))
+            && ipaUtf8 == natevolve::fromWstr(romanizer.unromanize(word));
+    }
+    std::wcout << L"Compiled-in romanization matches? " << compiledMatches << std::endl;
+    return longest == L"ʃʃ" && utf8Matches && compiledMatches;
+}
+
+bool testRomanizeCorpus(const natevolve::romanizer::Romanizer &romanizer) {
+    // Big enough to be split into several chunks
+    std::string text;
+    for (size_t i = 0; text.length() < (3 << 20); i++) {
+        text += natevolve::fromWstr(g_testWords[i % g_testWords.size()]);
+        text += i % 10 == 9 ? "\n" : " shathoihéllo ʃæθɑih ";
+    }
+
+    natevolve::Pool pool(4);
+    std::string serial;
+    std::string parallel;
+    romanizer.romanize(text, serial);
+    romanizer.romanizeCorpus(text, parallel, pool);
+    if (serial != parallel) {
+        std::wcout << L"Parallel romanization differs from serial" << std::endl;
+        return false;
+    }
+    serial.clear();
+    parallel.clear();
+    romanizer.unromanize(text, serial);
+    romanizer.unromanizeCorpus(text, parallel, pool);
+    if (serial != parallel) {
+        std::wcout << L"Parallel unromanization differs from serial" << std::endl;
+        return false;
+    }
+    std::wcout << L"Romanized a " << text.length() << L" byte corpus in parallel" << std::endl;
+    return true;
 }
 
 void printGenData(const natevolve::wordup::Generator &gen) {
@@ -182,3 +752,624 @@ void testWordGeneration(const natevolve::wordup::Generator &gen) {
     }
 }
 
+// Every way of building a word from a generator's settings, in index order
+static std::vector<std::wstring> buildableWords(const natevolve::wordup::Generator &gen) {
+    // Spell out every possible onset or coda by walking the categories by name
+    const auto expand = [&gen](const std::vector<std::vector<std::wstring>> &options) {
+        std::vector<std::wstring> parts;
+        for (const auto &opt : options) {
+            std::vector<std::wstring> partial = { L"" };
+            for (const auto &cat : opt) {
+                if (cat == L"∅") {
+                    break;
+                }
+                std::vector<std::wstring> longer;
+                for (const auto &prefix : partial) {
+                    for (const auto &sound : gen.categories.at(cat)) {
+                        longer.push_back(prefix + sound);
+                    }
+                }
+                partial = longer;
+            }
+            parts.insert(parts.end(), partial.begin(), partial.end());
+        }
+        return parts;
+    };
+    std::vector<std::wstring> syllables;
+    for (const auto &onset : expand(gen.onsetOptions)) {
+        for (const auto &vowel : gen.vowels) {
+            for (const auto &coda : expand(gen.codaOptions)) {
+                syllables.push_back(onset + vowel + coda);
+            }
+        }
+    }
+    std::vector<std::wstring> words;
+    for (const auto &count : gen.weights.syllables) {
+        std::vector<std::wstring> partial = { L"" };
+        for (size_t i = 0; i < count.first; i++) {
+            std::vector<std::wstring> longer;
+            for (const auto &prefix : partial) {
+                for (const auto &syllable : syllables) {
+                    longer.push_back(prefix + syllable);
+                }
+            }
+            partial = longer;
+        }
+        words.insert(words.end(), partial.begin(), partial.end());
+    }
+    return words;
+}
+
+// Every word a generator's settings allow, sorted
+static std::vector<std::wstring> allowedWords(const natevolve::wordup::Generator &gen) {
+    auto allowed = buildableWords(gen);
+    std::sort(allowed.begin(), allowed.end());
+    return allowed;
+}
+
+// Every generated word has to be one the generator's settings allow
+bool testCompiledGeneration(const natevolve::wordup::Generator &gen) {
+    const auto allowed = allowedWords(gen);
+
+    std::wstring word;
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < 100000; i++) {
+        const auto res = gen.generate(word);
+        if (res.has_value()) {
+            std::wcout << L"Compiled generation failed: " << res.value().message << std::endl;
+            return false;
+        }
+        if (!std::binary_search(allowed.begin(), allowed.end(), word)) {
+            std::wcout << L"Generated a word the settings don't allow: " << word << std::endl;
+            return false;
+        }
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    std::wcout
+        << L"Generated 100000 words in "
+        << std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()
+        << L" us" << std::endl;
+
+    // Unknown categories still only fail when they're picked
+    const natevolve::wordup::Generator broken(
+        gen.categories, gen.vowels, { { L"Q" } }, { { L"∅" } }
+    );
+    const auto brokenRes = broken.generate();
+    if (!natevolve::isErr(brokenRes)
+            || natevolve::err(brokenRes).type != natevolve::ErrorType::UnknownCategory
+            || natevolve::err(brokenRes).message != L"Q") {
+        std::wcout << L"Unknown category wasn't reported" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Bulk generation only depends on the seed, not on how many threads do it
+bool testBulkGeneration(const natevolve::wordup::Generator &gen) {
+    const size_t count = 1 << 21;
+    natevolve::Pool single(1);
+    natevolve::Pool pool;
+
+    auto start = std::chrono::steady_clock::now();
+    const auto serial = gen.generateN(count, single, 42);
+    const auto serialTime = std::chrono::steady_clock::now() - start;
+    start = std::chrono::steady_clock::now();
+    const auto parallel = gen.generateN(count, pool, 42);
+    const auto parallelTime = std::chrono::steady_clock::now() - start;
+    if (natevolve::isErr(serial) || natevolve::isErr(parallel)) {
+        std::wcout << L"Bulk generation failed" << std::endl;
+        return false;
+    }
+
+    const auto &words = natevolve::ok(parallel);
+    if (words.size() != count || words.text != natevolve::ok(serial).text
+            || words.offsets != natevolve::ok(serial).offsets) {
+        std::wcout << L"Bulk generation depends on the thread count" << std::endl;
+        return false;
+    }
+    const auto allowed = allowedWords(gen);
+    for (size_t i = 0; i < count; i += 97) {
+        if (!std::binary_search(allowed.begin(), allowed.end(), std::wstring(words.word(i)))) {
+            std::wcout << L"Bulk generated a word the settings don't allow: " << words.word(i)
+                << std::endl;
+            return false;
+        }
+    }
+
+    const auto other = gen.generateN(count, pool, 43);
+    if (natevolve::isErr(other) || natevolve::ok(other).text == words.text) {
+        std::wcout << L"Different seeds gave the same words" << std::endl;
+        return false;
+    }
+
+    std::wcout
+        << L"Generated " << count << L" words in "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(serialTime).count()
+        << L" ms on " << single.workers() << L" workers, "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(parallelTime).count()
+        << L" ms on " << pool.workers() << L" workers" << std::endl;
+    return true;
+}
+
+// A small engine from outside the library, to generate with
+struct SplitMix {
+    using result_type = uint64_t;
+
+    static constexpr uint64_t min(void) {
+        return 0;
+    }
+
+    static constexpr uint64_t max(void) {
+        return UINT64_MAX;
+    }
+
+    uint64_t operator()(void) {
+        auto z = (state += 0x9E3779B97F4A7C15);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+        return z ^ (z >> 31);
+    }
+
+    uint64_t state;
+};
+
+// Philox matches the paper's known answers, and any seeded word can be redone on its own
+bool testReproducibleGeneration(const natevolve::wordup::Generator &gen) {
+    const uint32_t known[3][10] = {
+        // Counter, key, expected output
+        { 0, 0, 0, 0, 0, 0, 0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8 },
+        {
+            0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+            0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd
+        }, {
+            0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344, 0xa4093822, 0x299f31d0,
+            0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1
+        }
+    };
+    for (const auto &test : known) {
+        uint32_t out[4];
+        natevolve::Philox::scramble(test, test + 4, out);
+        if (!std::equal(out, out + 4, test + 6)) {
+            std::wcout << L"Philox doesn't match its known answers" << std::endl;
+            return false;
+        }
+    }
+
+    const size_t count = 1 << 16;
+    natevolve::Pool pool;
+    const auto words = gen.generateN(count, pool, 42);
+    if (natevolve::isErr(words)) {
+        std::wcout << L"Bulk generation failed" << std::endl;
+        return false;
+    }
+    const auto &arena = std::get<natevolve::wordup::WordArena>(words);
+    std::wstring word;
+    for (size_t k = 0; k < count; k += 61) {
+        const auto res = gen.generateAt(42, k, word);
+        if (res.has_value() || word != arena.word(k)) {
+            std::wcout
+                << L"Word " << k << L" redone on its own is " << word << L", expected "
+                << arena.word(k) << std::endl;
+            return false;
+        }
+    }
+
+    // Any engine works, not just the ones the library uses itself
+    SplitMix splitMix { 42 };
+    const auto allowed = allowedWords(gen);
+    if (gen.generate(splitMix, word).has_value()
+            || !std::binary_search(allowed.begin(), allowed.end(), word)) {
+        std::wcout << L"Generating with a user's own engine failed" << std::endl;
+        return false;
+    }
+
+    // Compare the engines the way generateInto uses them: it used to seed an mt19937 for every
+    // chunk of words, and now gives every word its own Philox stream
+    const size_t draws = 1 << 20;
+    const size_t chunk = 4096;
+    size_t length = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t first = 0; first < draws; first += chunk) {
+        std::seed_seq seq { 42u, 0u, static_cast<uint32_t>(first / chunk), 0u };
+        std::mt19937 twister(seq);
+        for (auto i = first; i < first + chunk; i++) {
+            gen.generate(twister, word);
+            length += word.length();
+        }
+    }
+    const auto twisterTime = std::chrono::steady_clock::now() - start;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < draws; i++) {
+        natevolve::Philox philox(42, i);
+        gen.generate(philox, word);
+        length += word.length();
+    }
+    const auto philoxTime = std::chrono::steady_clock::now() - start;
+
+    std::wcout
+        << L"Generated " << draws << L" words on one thread in "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(twisterTime).count()
+        << L" ms with an mt19937 per " << chunk << L" words, "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(philoxTime).count()
+        << L" ms with a Philox stream per word (" << length << L" sounds)" << std::endl;
+    return true;
+}
+
+// Unique generation, both by sampling and by listing the whole space
+bool testUniqueGeneration(const natevolve::wordup::Generator &gen) {
+    natevolve::Pool pool;
+    auto allowed = allowedWords(gen);
+    if (gen.spaceSize() != allowed.size()) {
+        std::wcout
+            << L"Word space is " << gen.spaceSize() << L", expected " << allowed.size()
+            << std::endl;
+        return false;
+    }
+    allowed.erase(std::unique(allowed.begin(), allowed.end()), allowed.end());
+
+    // Every word is new and allowed. Asking for all of them has to give exactly all of them
+    const auto check = [&allowed](
+            const natevolve::Result<natevolve::wordup::WordArena> &res, const size_t count) {
+        if (natevolve::isErr(res) || natevolve::ok(res).size() != count) {
+            return false;
+        }
+        std::vector<std::wstring> words;
+        for (size_t i = 0; i < count; i++) {
+            words.push_back(std::wstring(natevolve::ok(res).word(i)));
+        }
+        std::sort(words.begin(), words.end());
+        return std::adjacent_find(words.begin(), words.end()) == words.end()
+            && std::includes(allowed.begin(), allowed.end(), words.begin(), words.end());
+    };
+    if (!check(gen.generateUnique(10, pool), 10)
+            || !check(gen.generateUnique(allowed.size(), pool), allowed.size())) {
+        std::wcout << L"Unique generation gave repeated or impossible words" << std::endl;
+        return false;
+    }
+    const auto tooMany = gen.generateUnique(allowed.size() + 1, pool);
+    if (!natevolve::isErr(tooMany)
+            || natevolve::err(tooMany).type != natevolve::ErrorType::OutOfRange) {
+        std::wcout << L"Asking for too many unique words didn't fail" << std::endl;
+        return false;
+    }
+
+    // Mostly one word spelled many ways, so sampling gives up and falls back to listing
+    std::vector<std::wstring> lopsided(100, L"p");
+    lopsided.push_back(L"q");
+    const natevolve::wordup::Generator skewed(
+        { { L"X", lopsided } }, { L"a" }, { { L"X" } }, { { L"∅" } }
+    );
+    const auto skewedRes = skewed.generateUnique(2, pool);
+    if (natevolve::isErr(skewedRes) || natevolve::ok(skewedRes).size() != 2
+            || natevolve::ok(skewedRes).word(0) == natevolve::ok(skewedRes).word(1)) {
+        std::wcout << L"Unique generation failed on a lopsided space" << std::endl;
+        return false;
+    }
+
+    // Too many ways to list, and one sound soaks up nearly every draw, so indices get drawn
+    std::vector<std::wstring> many;
+    for (int i = 0; i < 64; i++) {
+        many.push_back(std::wstring(1, static_cast<wchar_t>(L'\u0100' + i)));
+    }
+    natevolve::wordup::Weights manyWeights;
+    manyWeights.sounds[L"X"] = std::vector<double>(many.size(), 1);
+    manyWeights.sounds[L"X"][0] = 1e6;
+    manyWeights.syllables = { { 4, 1 } };
+    const natevolve::wordup::Generator huge(
+        { { L"X", many } }, { L"a" }, { { L"X" } }, { { L"∅" } }, manyWeights
+    );
+    const auto hugeRes = huge.generateUnique(50, pool);
+    if (natevolve::isErr(hugeRes) || natevolve::ok(hugeRes).size() != 50) {
+        std::wcout << L"Unique generation failed on a space too big to list" << std::endl;
+        return false;
+    }
+    std::vector<std::wstring> hugeWords;
+    for (size_t i = 0; i < 50; i++) {
+        hugeWords.push_back(std::wstring(natevolve::ok(hugeRes).word(i)));
+    }
+    std::sort(hugeWords.begin(), hugeWords.end());
+    if (std::adjacent_find(hugeWords.begin(), hugeWords.end()) != hugeWords.end()) {
+        std::wcout << L"Unique generation repeated words in a space too big to list" << std::endl;
+        return false;
+    }
+
+    std::wcout
+        << L"Unique generation found all " << allowed.size() << L" words of a space of "
+        << gen.spaceSize() << std::endl;
+    return true;
+}
+
+// Ranking, unranking and iterating all have to agree on the order of the word space
+bool testWordSpace(const natevolve::wordup::Generator &gen) {
+    const auto allowed = allowedWords(gen);
+    natevolve::wordup::WordIterator all(gen);
+    std::vector<std::wstring> listed;
+    std::wstring word;
+    std::wstring iterated;
+    for (uint64_t i = 0; i < gen.spaceSize(); i++) {
+        const auto res = gen.unrank(i, word);
+        if (res.has_value() || !std::binary_search(allowed.begin(), allowed.end(), word)) {
+            std::wcout << L"Couldn't unrank word " << i << std::endl;
+            return false;
+        }
+        const auto index = gen.rank(word);
+        if (natevolve::isErr(index) || natevolve::ok(index) > i
+                || natevolve::ok(gen.unrank(natevolve::ok(index))) != word) {
+            std::wcout << L"Ranking '" << word << L"' doesn't undo unranking it" << std::endl;
+            return false;
+        }
+        if (all.index() != i || !all.next(iterated) || iterated != word) {
+            std::wcout << L"Iterating doesn't match unranking at " << i << std::endl;
+            return false;
+        }
+        listed.push_back(word);
+    }
+    if (all.next(iterated)) {
+        std::wcout << L"Iterating went past the end of the word space" << std::endl;
+        return false;
+    }
+    std::sort(listed.begin(), listed.end());
+    if (listed != allowed) {
+        std::wcout << L"Unranking doesn't cover the word space" << std::endl;
+        return false;
+    }
+
+    // Resuming partway gives the same words
+    natevolve::wordup::WordIterator part(gen, 50, 80);
+    for (uint64_t i = 50; i < 80; i++) {
+        if (!part.next(iterated) || iterated != natevolve::ok(gen.unrank(i))) {
+            std::wcout << L"Iterating from the middle doesn't match at " << i << std::endl;
+            return false;
+        }
+    }
+    if (part.next(iterated) || !gen.unrank(gen.spaceSize(), word).has_value()
+            || !natevolve::isErr(gen.rank(L"xyz"))) {
+        std::wcout << L"Out of range words weren't rejected" << std::endl;
+        return false;
+    }
+    std::wcout << L"Ranked, unranked and iterated " << gen.spaceSize() << L" words" << std::endl;
+    return true;
+}
+
+// Weights and syllable counts have to survive a round trip through a file, and be followed
+bool testWeightedGeneration(void) {
+    const auto loaded = natevolve::wordup::Generator::fromFile("test/test-wordgen-weighted.wu");
+    if (natevolve::isErr(loaded)) {
+        std::wcout
+            << L"Error loading weighted generator: " << natevolve::err(loaded).message
+            << std::endl;
+        return false;
+    }
+    const auto &gen = std::get<natevolve::wordup::Generator>(loaded);
+    const auto &weights = gen.weights;
+    const std::vector<std::pair<size_t, double>> syllables = { { 1, 2 }, { 2, 1 } };
+    if (weights.sounds.at(L"C") != std::vector<double> { 3, 1, 0.5 }
+            || weights.sounds.at(L"N") != std::vector<double> { 1, 2 }
+            || weights.vowels != std::vector<double> { 3, 1 }
+            || weights.onsets != std::vector<double> { 1, 2 }
+            || weights.codas != std::vector<double> { 3, 1 }
+            || weights.syllables != syllables
+            || gen.vowels != std::vector<std::wstring> { L"a", L"i" }) {
+        std::wcout << L"Weights weren't read right" << std::endl;
+        return false;
+    }
+
+    const auto saved = gen.toFile("test/test-wordgen-weighted2.wu");
+    const auto reloaded = natevolve::wordup::Generator::fromFile("test/test-wordgen-weighted2.wu");
+    if (saved.has_value() || natevolve::isErr(reloaded)) {
+        std::wcout << L"Couldn't save and reload a weighted generator" << std::endl;
+        return false;
+    }
+    const auto &again = std::get<natevolve::wordup::Generator>(reloaded);
+    if (again.weights.sounds != weights.sounds || again.weights.vowels != weights.vowels
+            || again.weights.onsets != weights.onsets || again.weights.codas != weights.codas
+            || again.weights.syllables != weights.syllables
+            || again.categories != gen.categories || again.vowels != gen.vowels
+            || again.onsetOptions != gen.onsetOptions || again.codaOptions != gen.codaOptions) {
+        std::wcout << L"Weights didn't survive a round trip" << std::endl;
+        return false;
+    }
+
+    // An ASCII colon used as a length mark isn't a weight
+    const auto colons = natevolve::wordup::Generator::fromFile("test/test-wordgen-colon.wu");
+    if (natevolve::isErr(colons)) {
+        std::wcout
+            << L"Error loading generator with length marks: " << natevolve::err(colons).message
+            << std::endl;
+        return false;
+    }
+    const auto &colonGen = std::get<natevolve::wordup::Generator>(colons);
+    const std::vector<std::wstring> colonSounds = { L"p", L"t:", L"k" };
+    if (colonGen.categories.at(L"C") != colonSounds
+            || colonGen.weights.sounds.at(L"C") != std::vector<double> { 1, 1, 2 }
+            || colonGen.vowels != std::vector<std::wstring> { L"a:", L"i:" }
+            || colonGen.weights.vowels != std::vector<double> { 1, 2 }) {
+        std::wcout << L"Length marks were read as weights" << std::endl;
+        return false;
+    }
+    const auto colonSaved = colonGen.toFile("test/test-wordgen-colon2.wu");
+    const auto colonsAgain = natevolve::wordup::Generator::fromFile("test/test-wordgen-colon2.wu");
+    if (colonSaved.has_value() || natevolve::isErr(colonsAgain)
+            || natevolve::ok(colonsAgain).vowels != colonGen.vowels
+            || natevolve::ok(colonsAgain).weights.vowels != colonGen.weights.vowels) {
+        std::wcout << L"Length marks didn't survive a round trip" << std::endl;
+        return false;
+    }
+
+    // Longer words come after shorter ones in the word space
+    const auto buildable = buildableWords(gen);
+    natevolve::wordup::WordIterator all(gen);
+    std::wstring iterated;
+    if (gen.spaceSize() != buildable.size()) {
+        std::wcout << L"Multi-syllable word space is " << gen.spaceSize() << std::endl;
+        return false;
+    }
+    for (size_t i = 0; i < buildable.size(); i++) {
+        const auto index = gen.rank(buildable[i]);
+        if (natevolve::ok(gen.unrank(i)) != buildable[i] || !all.next(iterated)
+                || iterated != buildable[i] || natevolve::isErr(index)
+                || natevolve::ok(index) > i || buildable[natevolve::ok(index)] != buildable[i]) {
+            std::wcout << L"Multi-syllable word " << i << L" doesn't line up" << std::endl;
+            return false;
+        }
+    }
+
+    // A p onset three times out of four, and two syllables three times out of four
+    natevolve::wordup::Weights skew;
+    skew.sounds[L"C"] = { 3, 1 };
+    skew.syllables = { { 1, 1 }, { 2, 3 } };
+    const natevolve::wordup::Generator skewed(
+        { { L"C", { L"p", L"t" } } }, { L"a" }, { { L"C" } }, { { L"∅" } }, skew
+    );
+    natevolve::Pool pool;
+    const size_t count = 200000;
+    const auto words = skewed.generateN(count, pool, 7);
+    if (natevolve::isErr(words)) {
+        std::wcout << L"Weighted bulk generation failed" << std::endl;
+        return false;
+    }
+    const auto &arena = std::get<natevolve::wordup::WordArena>(words);
+    size_t twoSyllables = 0;
+    size_t ps = 0;
+    size_t onsets = 0;
+    for (size_t i = 0; i < count; i++) {
+        const auto word = arena.word(i);
+        twoSyllables += word.length() == 4;
+        for (size_t j = 0; j < word.length(); j += 2) {
+            ps += word[j] == L'p';
+            onsets++;
+        }
+    }
+    const auto twoShare = static_cast<double>(twoSyllables) / count;
+    const auto pShare = static_cast<double>(ps) / onsets;
+    std::wcout << L"Two syllables: " << twoShare << L", p onsets: " << pShare << std::endl;
+    if (twoShare < 0.74 || twoShare > 0.76 || pShare < 0.74 || pShare > 0.76) {
+        std::wcout << L"Weights weren't followed" << std::endl;
+        return false;
+    }
+
+    // Unique words listed from the whole space still never use t, and the only two words
+    // without it are all there is
+    natevolve::wordup::Weights noT;
+    noT.sounds[L"C"] = { 1, 0 };
+    noT.syllables = { { 1, 1 }, { 2, 1 } };
+    const natevolve::wordup::Generator withoutT(
+        { { L"C", { L"p", L"t" } } }, { L"a" }, { { L"C" } }, { { L"∅" } }, noT
+    );
+    const auto pair = withoutT.generateUnique(2, pool);
+    if (natevolve::isErr(pair) || natevolve::ok(pair).text.find(L't') != std::wstring::npos
+            || !natevolve::isErr(withoutT.generateUnique(3, pool))) {
+        std::wcout << L"Unique generation picked a sound with a weight of 0" << std::endl;
+        return false;
+    }
+
+    // A weight of 0 is written out as ':0' and read back the same
+    const auto zeroSaved = withoutT.toFile("test/test-wordgen-zero2.wu");
+    const auto zeroAgain = natevolve::wordup::Generator::fromFile("test/test-wordgen-zero2.wu");
+    if (zeroSaved.has_value() || natevolve::isErr(zeroAgain)
+            || natevolve::ok(zeroAgain).weights.sounds.at(L"C") != noT.sounds.at(L"C")) {
+        std::wcout << L"Generator with a weight of 0 didn't load back" << std::endl;
+        return false;
+    }
+
+    // And the one word picked from a listing follows the weights
+    natevolve::wordup::Weights nineToOne;
+    nineToOne.sounds[L"C"] = { 9, 1 };
+    const natevolve::wordup::Generator mostlyP(
+        { { L"C", { L"p", L"t" } } }, { L"a" }, { { L"C" } }, { { L"∅" } }, nineToOne
+    );
+    const size_t picks = 2000;
+    size_t uniquePs = 0;
+    for (size_t i = 0; i < picks; i++) {
+        const auto one = mostlyP.generateUnique(1, pool);
+        uniquePs += !natevolve::isErr(one) && natevolve::ok(one).word(0) == L"pa";
+    }
+    const auto uniqueShare = static_cast<double>(uniquePs) / picks;
+    std::wcout << L"Unique p words: " << uniqueShare << std::endl;
+    if (uniqueShare < 0.87 || uniqueShare > 0.93) {
+        std::wcout << L"Unique generation didn't follow the weights" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Every word out of a pipeline matches doing each stage by hand, gets past the filters, and is the
+// same however many threads ran it
+bool testPipeline(
+        const std::vector<natevolve::sndwrp::SoundChange> &changes,
+        const natevolve::romanizer::Romanizer &romanizer, const natevolve::wordup::Generator &gen) {
+    const natevolve::sndwrp::Cascade cascade(changes);
+    natevolve::Pool single(1);
+    natevolve::Pool pool;
+    const auto setUp = [&](natevolve::Pipeline &pipeline) {
+        pipeline.protoFilter.minLength = 2;
+        pipeline.evolvedFilter.maxLength = 4;
+        pipeline.romanizedFilter.blacklist = { L"ka" };
+        pipeline.romanizedFilter.homophones = true;
+    };
+    natevolve::Pipeline serial(gen, &cascade, &romanizer, 42, 5000);
+    natevolve::Pipeline parallel(gen, &cascade, &romanizer, 42, 5000);
+    setUp(serial);
+    setUp(parallel);
+
+    natevolve::PipelineBatch serialBatch;
+    natevolve::PipelineBatch batch;
+    std::vector<std::wstring> given;
+    std::wstring word;
+    std::wstring evolved;
+    std::wstring romanized;
+    natevolve::sndwrp::Workspace workspace;
+    for (int round = 0; round < 3; round++) {
+        const auto serialRes = serial.next(serialBatch, single);
+        const auto res = parallel.next(batch, pool);
+        if (serialRes.has_value() || res.has_value()) {
+            std::wcout << L"Pipeline failed" << std::endl;
+            return false;
+        }
+        if (batch.romanized.text != serialBatch.romanized.text
+                || batch.indices != serialBatch.indices) {
+            std::wcout << L"Pipeline output depends on the thread count" << std::endl;
+            return false;
+        }
+        for (size_t i = 0; i < batch.indices.size(); i++) {
+            gen.generateAt(42, batch.indices[i], word);
+            cascade.apply(word, evolved, workspace);
+            romanizer.romanize(evolved, romanized);
+            if (word != batch.proto.word(i) || evolved != batch.evolved.word(i)
+                    || romanized != batch.romanized.word(i)) {
+                std::wcout
+                    << L"Pipeline gave " << batch.proto.word(i) << L" > "
+                    << batch.evolved.word(i) << L" > " << batch.romanized.word(i)
+                    << L", expected " << word << L" > " << evolved << L" > " << romanized
+                    << std::endl;
+                return false;
+            }
+            if (parallel.protoFilter.rejects(word) || parallel.evolvedFilter.rejects(evolved)
+                    || parallel.romanizedFilter.rejects(romanized)) {
+                std::wcout << L"Pipeline let through " << romanized << std::endl;
+                return false;
+            }
+            given.push_back(romanized);
+        }
+    }
+    std::sort(given.begin(), given.end());
+    if (std::adjacent_find(given.begin(), given.end()) != given.end()) {
+        std::wcout << L"Pipeline gave the same romanized word twice" << std::endl;
+        return false;
+    }
+
+    const auto &stats = parallel.stats;
+    if (given.size() + stats.generate.rejected + stats.evolve.rejected + stats.romanize.rejected
+            != stats.generate.words) {
+        std::wcout << L"Pipeline lost count of the words it turned away" << std::endl;
+        return false;
+    }
+    std::wcout << L"Pipeline kept " << given.size() << L" of " << stats.generate.words
+        << L" words. Words/s per thread: generate " << stats.generate.wordsPerSecond()
+        << L" (" << stats.generate.rejected << L" rejected), evolve "
+        << stats.evolve.wordsPerSecond() << L" (" << stats.evolve.rejected
+        << L" rejected), romanize " << stats.romanize.wordsPerSecond() << L" ("
+        << stats.romanize.rejected << L" rejected), homophone check "
+        << stats.collect.wordsPerSecond() << std::endl;
+    return true;
+}
@@ -0,0 +1,7 @@
+f>v/{#}_{}
+p v/{}_{}
+
+t>d/{a}_{
+k>g/{}_{} x
+   
+m>n/{}_{}
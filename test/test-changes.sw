@@ -2,3 +2,4 @@
 p>k/{aiu}_{}
 t  > d/{}_{#}
 x >  h / { p t k } _ { m n }
+d͡ʒ > ʒ / {a i u} _ {}